@@ -479,20 +479,25 @@ static int kvm_physical_sync_dirty_bitmap(KVMMemoryListener *kml,
          * too, in most cases).
          * So for now, let's align to 64 instead of HOST_LONG_BITS here, in
          * a hope that sizeof(long) won't become >8 any time soon.
+         *
+         * The buffer is kept in the slot so that large guests do not
+         * allocate and fault in a new bitmap on every sync; the kernel
+         * overwrites all of it on each KVM_GET_DIRTY_LOG.
          */
-        size = ALIGN(((mem->memory_size) >> TARGET_PAGE_BITS),
-                     /*HOST_LONG_BITS*/ 64) / 8;
-        d.dirty_bitmap = g_malloc0(size);
+        if (!mem->dirty_bmap) {
+            size = ALIGN(((mem->memory_size) >> TARGET_PAGE_BITS),
+                         /*HOST_LONG_BITS*/ 64) / 8;
+            mem->dirty_bmap = g_malloc0(size);
+        }
+        d.dirty_bitmap = mem->dirty_bmap;
 
         d.slot = mem->slot | (kml->as_id << 16);
         if (kvm_vm_ioctl(s, KVM_GET_DIRTY_LOG, &d) == -1) {
             DPRINTF("ioctl failed %d\n", errno);
-            g_free(d.dirty_bitmap);
             return -1;
         }
 
         kvm_get_dirty_pages_log_range(section, d.dirty_bitmap);
-        g_free(d.dirty_bitmap);
     }
 
     return 0;
@@ -725,6 +730,8 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
         }
 
         /* unregister the slot */
+        g_free(mem->dirty_bmap);
+        mem->dirty_bmap = NULL;
         mem->memory_size = 0;
         err = kvm_set_user_memory_region(kml, mem);
         if (err) {
@@ -2273,6 +2273,210 @@ int bdrv_readv_vmstate(BlockDriverState *bs, QEMUIOVector *qiov, int64_t pos)
     return bdrv_rw_vmstate(bs, qiov, pos, true);
 }
 
+/**************************************************************/
+/* pipelined vmstate streams */
+
+/* The VM state is a sequential stream.  Instead of one synchronous request
+ * per QEMUFile buffer, it is transferred in large chunks that are aligned
+ * to their size, with several of them in flight at once: writes proceed
+ * while the next chunk is filled, and reads run ahead of the consumer.
+ */
+#define BDRV_VMSTATE_CHUNK_SIZE     (1 * 1024 * 1024)
+#define BDRV_VMSTATE_MAX_INFLIGHT   8
+
+typedef struct BdrvVMStateChunk {
+    BdrvVMStateIO   *s;
+    uint8_t         *buf;
+    int64_t         pos;
+    size_t          bytes;      /* filled (writes) or valid (reads) */
+    int             ret;        /* -EINPROGRESS while in flight */
+} BdrvVMStateChunk;
+
+struct BdrvVMStateIO {
+    BlockDriverState    *bs;
+    bool                is_read;
+    int                 ret;    /* first write error */
+    unsigned            cur;    /* chunk being filled (writes) */
+    BdrvVMStateChunk    chunks[BDRV_VMSTATE_MAX_INFLIGHT];
+};
+
+static void coroutine_fn bdrv_vmstate_io_entry(void *opaque)
+{
+    BdrvVMStateChunk *c = opaque;
+    BlockDriverState *bs = c->s->bs;
+    QEMUIOVector qiov;
+    struct iovec iov = {
+        .iov_base   = c->buf,
+        .iov_len    = c->bytes,
+    };
+    int ret;
+
+    qemu_iovec_init_external(&qiov, &iov, 1);
+    ret = bdrv_co_rw_vmstate(bs, &qiov, c->pos, c->s->is_read);
+    atomic_mb_set(&c->ret, ret);
+
+    /* Wake up bdrv_vmstate_io_wait only once the result is visible.  */
+    bdrv_dec_in_flight(bs);
+}
+
+static void bdrv_vmstate_io_submit(BdrvVMStateChunk *c)
+{
+    BlockDriverState *bs = c->s->bs;
+    Coroutine *co;
+
+    if (!c->buf) {
+        c->buf = qemu_blockalign(bs, BDRV_VMSTATE_CHUNK_SIZE);
+    }
+    c->ret = -EINPROGRESS;
+    bdrv_inc_in_flight(bs);
+    co = qemu_coroutine_create(bdrv_vmstate_io_entry, c);
+    bdrv_coroutine_enter(bs, co);
+}
+
+static int bdrv_vmstate_io_wait(BdrvVMStateChunk *c)
+{
+    BDRV_POLL_WHILE(c->s->bs, atomic_read(&c->ret) == -EINPROGRESS);
+    return c->ret;
+}
+
+BdrvVMStateIO *bdrv_vmstate_io_new(BlockDriverState *bs, bool is_read)
+{
+    BdrvVMStateIO *s = g_new0(BdrvVMStateIO, 1);
+    int i;
+
+    assert(!qemu_in_coroutine());
+    s->bs = bs;
+    s->is_read = is_read;
+    for (i = 0; i < BDRV_VMSTATE_MAX_INFLIGHT; i++) {
+        s->chunks[i].s = s;
+        s->chunks[i].pos = -1;
+    }
+    return s;
+}
+
+/* Start writing the chunk being filled and make the next one current,
+ * waiting for the write that previously used it.
+ */
+static void bdrv_vmstate_io_next(BdrvVMStateIO *s)
+{
+    BdrvVMStateChunk *c = &s->chunks[s->cur];
+    int ret;
+
+    bdrv_vmstate_io_submit(c);
+    s->cur = (s->cur + 1) % BDRV_VMSTATE_MAX_INFLIGHT;
+
+    c = &s->chunks[s->cur];
+    ret = bdrv_vmstate_io_wait(c);
+    if (ret < 0 && s->ret == 0) {
+        s->ret = ret;
+    }
+    c->ret = 0;
+    c->bytes = 0;
+}
+
+int bdrv_vmstate_io_writev(BdrvVMStateIO *s, QEMUIOVector *qiov, int64_t pos)
+{
+    size_t done = 0;
+
+    assert(!s->is_read);
+    while (done < qiov->size && s->ret == 0) {
+        BdrvVMStateChunk *c = &s->chunks[s->cur];
+        size_t n;
+
+        if (c->bytes && c->pos + c->bytes != pos + done) {
+            /* Not contiguous with the current chunk, start a new one.  */
+            bdrv_vmstate_io_next(s);
+            continue;
+        }
+        if (!c->bytes) {
+            c->pos = pos + done;
+            if (!c->buf) {
+                c->buf = qemu_blockalign(s->bs, BDRV_VMSTATE_CHUNK_SIZE);
+            }
+        }
+
+        /* Stop at the next chunk boundary, so that chunks stay aligned.  */
+        n = MIN(qiov->size - done,
+                QEMU_ALIGN_UP(c->pos + 1, BDRV_VMSTATE_CHUNK_SIZE) -
+                (c->pos + c->bytes));
+        qemu_iovec_to_buf(qiov, done, c->buf + c->bytes, n);
+        c->bytes += n;
+        done += n;
+
+        if (c->pos + c->bytes ==
+            QEMU_ALIGN_UP(c->pos + 1, BDRV_VMSTATE_CHUNK_SIZE)) {
+            bdrv_vmstate_io_next(s);
+        }
+    }
+    return s->ret;
+}
+
+int bdrv_vmstate_io_read(BdrvVMStateIO *s, uint8_t *buf, int64_t pos, int size)
+{
+    int64_t base = QEMU_ALIGN_DOWN(pos, BDRV_VMSTATE_CHUNK_SIZE);
+    BdrvVMStateChunk *c;
+    int64_t n;
+    int i;
+
+    assert(s->is_read);
+
+    /* Chunk k of the stream lives in slot k % BDRV_VMSTATE_MAX_INFLIGHT.
+     * Make sure the chunk holding @pos and the ones after it are loaded
+     * or on their way; slots holding anything else are stale.
+     */
+    for (i = 0; i < BDRV_VMSTATE_MAX_INFLIGHT; i++) {
+        int64_t chunk_pos = base + (int64_t)i * BDRV_VMSTATE_CHUNK_SIZE;
+
+        c = &s->chunks[(chunk_pos / BDRV_VMSTATE_CHUNK_SIZE) %
+                       BDRV_VMSTATE_MAX_INFLIGHT];
+        if (c->pos != chunk_pos) {
+            bdrv_vmstate_io_wait(c);
+            c->pos = chunk_pos;
+            c->bytes = BDRV_VMSTATE_CHUNK_SIZE;
+            bdrv_vmstate_io_submit(c);
+        }
+    }
+
+    c = &s->chunks[(base / BDRV_VMSTATE_CHUNK_SIZE) %
+                   BDRV_VMSTATE_MAX_INFLIGHT];
+    if (bdrv_vmstate_io_wait(c) < 0) {
+        /* The chunk may extend past what the driver can read; forget it
+         * and only report errors for the bytes actually requested.
+         */
+        c->pos = -1;
+        return bdrv_load_vmstate(s->bs, buf, pos, size);
+    }
+
+    n = MIN(size, base + BDRV_VMSTATE_CHUNK_SIZE - pos);
+    memcpy(buf, c->buf + (pos - base), n);
+    return n;
+}
+
+int bdrv_vmstate_io_close(BdrvVMStateIO *s)
+{
+    int i, ret;
+
+    if (!s->is_read && s->chunks[s->cur].bytes) {
+        bdrv_vmstate_io_next(s);
+    }
+    for (i = 0; i < BDRV_VMSTATE_MAX_INFLIGHT; i++) {
+        BdrvVMStateChunk *c = &s->chunks[i];
+
+        ret = bdrv_vmstate_io_wait(c);
+        if (!s->is_read && ret < 0 && s->ret == 0) {
+            s->ret = ret;
+        }
+        qemu_vfree(c->buf);
+    }
+
+    ret = s->ret;
+    if (ret == 0) {
+        ret = bdrv_flush(s->bs);
+    }
+    g_free(s);
+    return ret;
+}
+
 /**************************************************************/
 /* async I/Os */
 
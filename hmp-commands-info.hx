@@ -865,6 +865,37 @@ STEXI
 @findex info memory_size_summary
 Display the amount of initially allocated and present hotpluggable (if
 enabled) memory in bytes.
+ETEXI
+
+    {
+        .name       = "coroutines",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show coroutine pool statistics",
+        .cmd        = hmp_info_coroutines,
+    },
+
+STEXI
+@item info coroutines
+@findex info coroutines
+Show how many coroutine stacks were allocated and freed, and the size
+of the coroutine pools.  Stacks that are allocated but not freed are
+either in use or kept in a pool for reuse.
+ETEXI
+
+    {
+        .name       = "rcu",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show RCU grace period statistics",
+        .cmd        = hmp_info_rcu,
+    },
+
+STEXI
+@item info rcu
+@findex info rcu
+Show how many RCU grace periods have completed and how long they took,
+and how many RCU callbacks have been invoked or are still queued.
 ETEXI
 
 STEXI
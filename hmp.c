@@ -38,7 +38,9 @@
 #include "block/qapi.h"
 #include "qemu-io.h"
 #include "qemu/cutils.h"
+#include "qemu/coroutine.h"
 #include "qemu/error-report.h"
+#include "qemu/rcu.h"
 #include "exec/ramlist.h"
 #include "hw/intc/intc.h"
 #include "migration/snapshot.h"
@@ -222,6 +224,8 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->ram->normal_bytes >> 10);
         monitor_printf(mon, "dirty sync count: %" PRIu64 "\n",
                        info->ram->dirty_sync_count);
+        monitor_printf(mon, "dirty sync time: %" PRIu64 " microseconds\n",
+                       info->ram->dirty_sync_time);
         monitor_printf(mon, "page size: %" PRIu64 " kbytes\n",
                        info->ram->page_size >> 10);
 
@@ -2471,6 +2475,21 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "  poll-max-ns=%" PRId64 "\n", value->poll_max_ns);
         monitor_printf(mon, "  poll-grow=%" PRId64 "\n", value->poll_grow);
         monitor_printf(mon, "  poll-shrink=%" PRId64 "\n", value->poll_shrink);
+        monitor_printf(mon, "  poll-hits=%" PRIu64 " poll-misses=%" PRIu64
+                       " poll-busy-ns=%" PRIu64 "\n",
+                       value->poll_hits, value->poll_misses,
+                       value->poll_busy_ns);
+        monitor_printf(mon, "  thread-pool-min=%" PRId64 "\n",
+                       value->thread_pool_min);
+        monitor_printf(mon, "  thread-pool-max=%" PRId64 "\n",
+                       value->thread_pool_max);
+        monitor_printf(mon, "  thread-pool-threads=%" PRId64
+                       " idle=%" PRId64 " requests=%" PRIu64
+                       " steals=%" PRIu64 "\n",
+                       value->thread_pool_threads,
+                       value->thread_pool_idle_threads,
+                       value->thread_pool_requests,
+                       value->thread_pool_steals);
     }
 
     qapi_free_IOThreadInfoList(info_list);
@@ -2918,3 +2937,29 @@ void hmp_info_memory_size_summary(Monitor *mon, const QDict *qdict)
     }
     hmp_handle_error(mon, &err);
 }
+
+void hmp_info_coroutines(Monitor *mon, const QDict *qdict)
+{
+    CoroutinePoolStats stats;
+
+    qemu_coroutine_get_pool_stats(&stats);
+    monitor_printf(mon, "stacks allocated: %lu\n", stats.allocated);
+    monitor_printf(mon, "stacks freed: %lu\n", stats.freed);
+    monitor_printf(mon, "pool refills: %lu\n", stats.refills);
+    monitor_printf(mon, "pool batch size: %u\n", stats.batch_size);
+}
+
+void hmp_info_rcu(Monitor *mon, const QDict *qdict)
+{
+    RCUStats stats;
+
+    rcu_get_stats(&stats);
+    monitor_printf(mon, "grace periods: %" PRIu64 "\n", stats.grace_periods);
+    monitor_printf(mon, "average grace period: %" PRIu64 " ns\n",
+                   stats.grace_periods ?
+                   stats.grace_period_ns / stats.grace_periods : 0);
+    monitor_printf(mon, "max grace period: %" PRIu64 " ns\n",
+                   stats.max_grace_period_ns);
+    monitor_printf(mon, "callbacks invoked: %" PRIu64 "\n", stats.callbacks);
+    monitor_printf(mon, "callbacks pending: %d\n", stats.pending_callbacks);
+}
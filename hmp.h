@@ -147,5 +147,7 @@ void hmp_info_ramblock(Monitor *mon, const QDict *qdict);
 void hmp_hotpluggable_cpus(Monitor *mon, const QDict *qdict);
 void hmp_info_vm_generation_id(Monitor *mon, const QDict *qdict);
 void hmp_info_memory_size_summary(Monitor *mon, const QDict *qdict);
+void hmp_info_coroutines(Monitor *mon, const QDict *qdict);
+void hmp_info_rcu(Monitor *mon, const QDict *qdict);
 
 #endif
@@ -13,6 +13,8 @@
 
 #include "qemu/osdep.h"
 #include "qapi/error.h"
+#include "qapi/visitor.h"
+#include "qapi-visit.h"
 #include "qemu-common.h"
 #include "qemu/iov.h"
 #include "qemu/error-report.h"
@@ -29,6 +31,14 @@
 #include "hw/virtio/virtio-bus.h"
 #include "hw/virtio/virtio-access.h"
 
+/* Maximum number of requests taken off a virtqueue at once */
+#define VIRTIO_BLK_POP_BATCH 32
+
+#define VIRTIO_BLK_QUEUE_SIZE 128
+
+/* Coroutines kept in the pool for each virtqueue, see realize */
+#define VIRTIO_BLK_COROUTINE_POOL_SIZE (VIRTIO_BLK_QUEUE_SIZE / 2)
+
 static void virtio_blk_init_request(VirtIOBlock *s, VirtQueue *vq,
                                     VirtIOBlockReq *req)
 {
@@ -45,6 +55,15 @@ static void virtio_blk_free_request(VirtIOBlockReq *req)
     g_free(req);
 }
 
+static void virtio_blk_notify_guest(VirtIOBlock *s, VirtQueue *vq)
+{
+    if (s->dataplane_started && !s->dataplane_disabled) {
+        virtio_blk_data_plane_notify(s->dataplane, vq);
+    } else {
+        virtio_notify(VIRTIO_DEVICE(s), vq);
+    }
+}
+
 static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
 {
     VirtIOBlock *s = req->dev;
@@ -54,10 +73,40 @@ static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
 
     stb_p(&req->in->status, status);
     virtqueue_push(req->vq, &req->elem, req->in_len);
-    if (s->dataplane_started && !s->dataplane_disabled) {
-        virtio_blk_data_plane_notify(s->dataplane, req->vq);
-    } else {
-        virtio_notify(vdev, req->vq);
+    virtio_blk_notify_guest(s, req->vq);
+}
+
+/* Complete requests with one used ring update and notification for each
+ * run of requests from the same virtqueue.  A merged chain can mix queues
+ * when it is built from s->rq by virtio_blk_dma_restart_bh.
+ */
+static void virtio_blk_req_complete_batch(VirtIOBlockReq **reqs,
+                                          unsigned int num,
+                                          unsigned char status)
+{
+    VirtIOBlock *s = reqs[0]->dev;
+    VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    VirtQueueElement *elems[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int lens[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int i, start;
+
+    assert(num <= VIRTIO_BLK_MAX_MERGE_REQS);
+    for (i = 0; i < num; i++) {
+        trace_virtio_blk_req_complete(vdev, reqs[i], status);
+        stb_p(&reqs[i]->in->status, status);
+        elems[i] = &reqs[i]->elem;
+        lens[i] = reqs[i]->in_len;
+    }
+
+    for (start = 0; start < num; start = i) {
+        VirtQueue *vq = reqs[start]->vq;
+
+        i = start + 1;
+        while (i < num && reqs[i]->vq == vq) {
+            i++;
+        }
+        virtqueue_push_batch(vq, elems + start, lens + start, i - start);
+        virtio_blk_notify_guest(s, vq);
     }
 }
 
@@ -89,6 +138,8 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
     VirtIOBlockReq *next = opaque;
     VirtIOBlock *s = next->dev;
     VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    VirtIOBlockReq *done[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int i, num_done = 0;
 
     aio_context_acquire(blk_get_aio_context(s->conf.conf.blk));
     while (next) {
@@ -119,9 +170,16 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
             }
         }
 
-        virtio_blk_req_complete(req, VIRTIO_BLK_S_OK);
-        block_acct_done(blk_get_stats(req->dev->blk), &req->acct);
-        virtio_blk_free_request(req);
+        /* A merged request chain never exceeds the size of a MultiReqBuffer */
+        done[num_done++] = req;
+    }
+
+    if (num_done) {
+        virtio_blk_req_complete_batch(done, num_done, VIRTIO_BLK_S_OK);
+        for (i = 0; i < num_done; i++) {
+            block_acct_done(blk_get_stats(s->blk), &done[i]->acct);
+            virtio_blk_free_request(done[i]);
+        }
     }
     aio_context_release(blk_get_aio_context(s->conf.conf.blk));
 }
@@ -199,14 +257,17 @@ out:
 
 #endif
 
-static VirtIOBlockReq *virtio_blk_get_request(VirtIOBlock *s, VirtQueue *vq)
+static unsigned int virtio_blk_get_requests(VirtIOBlock *s, VirtQueue *vq,
+                                            VirtIOBlockReq **reqs,
+                                            unsigned int max)
 {
-    VirtIOBlockReq *req = virtqueue_pop(vq, sizeof(VirtIOBlockReq));
+    unsigned int i, num;
 
-    if (req) {
-        virtio_blk_init_request(s, vq, req);
+    num = virtqueue_pop_batch(vq, sizeof(VirtIOBlockReq), (void **)reqs, max);
+    for (i = 0; i < num; i++) {
+        virtio_blk_init_request(s, vq, reqs[i]);
     }
-    return req;
+    return num;
 }
 
 static int virtio_blk_handle_scsi_req(VirtIOBlockReq *req)
@@ -594,7 +655,8 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 
 bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
 {
-    VirtIOBlockReq *req;
+    VirtIOBlockReq *reqs[VIRTIO_BLK_POP_BATCH];
+    unsigned int i, num_reqs;
     MultiReqBuffer mrb = {};
     bool progress = false;
 
@@ -604,11 +666,21 @@ bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
     do {
         virtio_queue_set_notification(vq, 0);
 
-        while ((req = virtio_blk_get_request(s, vq))) {
+        while ((num_reqs = virtio_blk_get_requests(s, vq, reqs,
+                                                   ARRAY_SIZE(reqs)))) {
             progress = true;
-            if (virtio_blk_handle_request(req, &mrb)) {
-                virtqueue_detach_element(req->vq, &req->elem, 0);
-                virtio_blk_free_request(req);
+            s->vq_requests[virtio_get_queue_index(vq)] += num_reqs;
+            for (i = 0; i < num_reqs; i++) {
+                if (virtio_blk_handle_request(reqs[i], &mrb)) {
+                    break;
+                }
+            }
+            if (i < num_reqs) {
+                /* The device is broken, drop the rest of the batch too */
+                for (; i < num_reqs; i++) {
+                    virtqueue_detach_element(vq, &reqs[i]->elem, 0);
+                    virtio_blk_free_request(reqs[i]);
+                }
                 break;
             }
         }
@@ -862,7 +934,7 @@ static void virtio_blk_save_device(VirtIODevice *vdev, QEMUFile *f)
             qemu_put_be32(f, virtio_get_queue_index(req->vq));
         }
 
-        qemu_put_virtqueue_element(f, &req->elem);
+        qemu_put_virtqueue_element(vdev, f, &req->elem);
         req = req->next;
     }
     qemu_put_sbyte(f, 0);
@@ -953,15 +1025,25 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
     s->sector_mask = (s->conf.conf.logical_block_size / BDRV_SECTOR_SIZE) - 1;
 
     for (i = 0; i < conf->num_queues; i++) {
-        virtio_add_queue(vdev, 128, virtio_blk_handle_output);
+        virtio_add_queue(vdev, VIRTIO_BLK_QUEUE_SIZE, virtio_blk_handle_output);
     }
+    s->vq_requests = g_new0(uint64_t, conf->num_queues);
     virtio_blk_data_plane_create(vdev, conf, &s->dataplane, &err);
     if (err != NULL) {
         error_propagate(errp, err);
+        g_free(s->vq_requests);
+        s->vq_requests = NULL;
         virtio_cleanup(vdev);
         return;
     }
 
+    /*
+     * Each request in flight runs in its own coroutine; keep enough of
+     * them pooled that a full queue does not keep reallocating stacks.
+     */
+    qemu_coroutine_increase_pool_batch_size(conf->num_queues *
+                                            VIRTIO_BLK_COROUTINE_POOL_SIZE);
+
     s->change = qemu_add_vm_change_state_handler(virtio_blk_dma_restart_cb, s);
     blk_set_dev_ops(s->blk, &virtio_block_ops, s);
     blk_set_guest_block_size(s->blk, s->conf.conf.logical_block_size);
@@ -976,11 +1058,41 @@ static void virtio_blk_device_unrealize(DeviceState *dev, Error **errp)
 
     virtio_blk_data_plane_destroy(s->dataplane);
     s->dataplane = NULL;
+    qemu_coroutine_decrease_pool_batch_size(s->conf.num_queues *
+                                            VIRTIO_BLK_COROUTINE_POOL_SIZE);
     qemu_del_vm_change_state_handler(s->change);
     blockdev_mark_auto_del(s->blk);
+    g_free(s->vq_requests);
+    s->vq_requests = NULL;
     virtio_cleanup(vdev);
 }
 
+static void virtio_blk_get_queue_requests(Object *obj, Visitor *v,
+                                          const char *name, void *opaque,
+                                          Error **errp)
+{
+    VirtIOBlock *s = VIRTIO_BLK(obj);
+    uint64List *list = NULL;
+    uint64List **entry = &list;
+    AioContext *ctx;
+    unsigned i;
+
+    if (s->vq_requests) {
+        /* The counters are updated in the IOThread with dataplane */
+        ctx = blk_get_aio_context(s->blk);
+        aio_context_acquire(ctx);
+        for (i = 0; i < s->conf.num_queues; i++) {
+            *entry = g_malloc0(sizeof(**entry));
+            (*entry)->value = s->vq_requests[i];
+            entry = &(*entry)->next;
+        }
+        aio_context_release(ctx);
+    }
+
+    visit_type_uint64List(v, name, &list, errp);
+    qapi_free_uint64List(list);
+}
+
 static void virtio_blk_instance_init(Object *obj)
 {
     VirtIOBlock *s = VIRTIO_BLK(obj);
@@ -988,6 +1100,9 @@ static void virtio_blk_instance_init(Object *obj)
     device_add_bootindex_property(obj, &s->conf.conf.bootindex,
                                   "bootindex", "/disk@0,0",
                                   DEVICE(obj), NULL);
+    object_property_add(obj, "x-queue-requests", "uint64List",
+                        virtio_blk_get_queue_requests, NULL, NULL, NULL,
+                        NULL);
 }
 
 static const VMStateDescription vmstate_virtio_blk = {
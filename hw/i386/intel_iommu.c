@@ -171,6 +171,12 @@ static gboolean vtd_hash_remove_by_page(gpointer key, gpointer value,
              (entry->gfn == gfn_tlb));
 }
 
+/* Drop the per-device copies of IOTLB entries in one go */
+static void vtd_iotlb_cache_flush(IntelIOMMUState *s)
+{
+    s->iotlb_gen++;
+}
+
 /* Reset all the gen of VTDAddressSpace to zero and set the gen of
  * IntelIOMMUState to 1.
  */
@@ -195,12 +201,14 @@ static void vtd_reset_context_cache(IntelIOMMUState *s)
         }
     }
     s->context_cache_gen = 1;
+    vtd_iotlb_cache_flush(s);
 }
 
 static void vtd_reset_iotlb(IntelIOMMUState *s)
 {
     assert(s->iotlb);
     g_hash_table_remove_all(s->iotlb);
+    vtd_iotlb_cache_flush(s);
 }
 
 static uint64_t vtd_get_iotlb_key(uint64_t gfn, uint16_t source_id,
@@ -235,6 +243,52 @@ out:
     return entry;
 }
 
+static inline VTDIOTLBCacheEntry *vtd_iotlb_cache_slot(VTDAddressSpace *vtd_as,
+                                                       hwaddr addr,
+                                                       uint64_t mask)
+{
+    unsigned shift = ctz64(mask);
+
+    return &vtd_as->iotlb_cache[((addr >> shift) ^ shift) &
+                                (VTD_IOTLB_CACHE_SIZE - 1)];
+}
+
+/* Look up @addr in the device's own translation cache, trying the page
+ * sizes in the same order as vtd_lookup_iotlb().
+ */
+static VTDIOTLBCacheEntry *vtd_lookup_iotlb_cache(VTDAddressSpace *vtd_as,
+                                                  hwaddr addr)
+{
+    IntelIOMMUState *s = vtd_as->iommu_state;
+    VTDIOTLBCacheEntry *entry;
+    uint64_t mask;
+    int level;
+
+    for (level = VTD_SL_PT_LEVEL; level < VTD_SL_PML4_LEVEL; level++) {
+        mask = vtd_slpt_level_page_mask(level);
+        entry = vtd_iotlb_cache_slot(vtd_as, addr, mask);
+        if (entry->gen == s->iotlb_gen && entry->mask == mask &&
+            entry->iova == (addr & mask)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void vtd_update_iotlb_cache(VTDAddressSpace *vtd_as, hwaddr addr,
+                                   uint64_t mask, uint64_t slpte,
+                                   uint16_t domain_id, uint8_t access_flags)
+{
+    VTDIOTLBCacheEntry *entry = vtd_iotlb_cache_slot(vtd_as, addr, mask);
+
+    entry->gen = vtd_as->iommu_state->iotlb_gen;
+    entry->iova = addr & mask;
+    entry->mask = mask;
+    entry->slpte = slpte;
+    entry->domain_id = domain_id;
+    entry->access_flags = access_flags;
+}
+
 static void vtd_update_iotlb(IntelIOMMUState *s, uint16_t source_id,
                              uint16_t domain_id, hwaddr addr, uint64_t slpte,
                              uint8_t access_flags, uint32_t level)
@@ -1101,7 +1155,9 @@ static bool vtd_do_iommu_translate(VTDAddressSpace *vtd_as, PCIBus *bus,
     bool reads = true;
     bool writes = true;
     uint8_t access_flags;
+    uint16_t domain_id;
     VTDIOTLBEntry *iotlb_entry;
+    VTDIOTLBCacheEntry *cache_entry;
 
     /*
      * We have standalone memory region for interrupt addresses, we
@@ -1109,6 +1165,17 @@ static bool vtd_do_iommu_translate(VTDAddressSpace *vtd_as, PCIBus *bus,
      */
     assert(!vtd_is_interrupt_addr(addr));
 
+    /* Try the device's own translation cache first */
+    cache_entry = vtd_lookup_iotlb_cache(vtd_as, addr);
+    if (cache_entry) {
+        trace_vtd_iotlb_cache_hit(source_id, addr, cache_entry->slpte,
+                                  cache_entry->domain_id);
+        slpte = cache_entry->slpte;
+        access_flags = cache_entry->access_flags;
+        page_mask = cache_entry->mask;
+        goto out;
+    }
+
     /* Try to fetch slpte form IOTLB */
     iotlb_entry = vtd_lookup_iotlb(s, source_id, addr);
     if (iotlb_entry) {
@@ -1117,6 +1184,8 @@ static bool vtd_do_iommu_translate(VTDAddressSpace *vtd_as, PCIBus *bus,
         slpte = iotlb_entry->slpte;
         access_flags = iotlb_entry->access_flags;
         page_mask = iotlb_entry->mask;
+        vtd_update_iotlb_cache(vtd_as, addr, page_mask, slpte,
+                               iotlb_entry->domain_id, access_flags);
         goto out;
     }
 
@@ -1186,8 +1255,11 @@ static bool vtd_do_iommu_translate(VTDAddressSpace *vtd_as, PCIBus *bus,
 
     page_mask = vtd_slpt_level_page_mask(level);
     access_flags = IOMMU_ACCESS_FLAG(reads, writes);
-    vtd_update_iotlb(s, source_id, VTD_CONTEXT_ENTRY_DID(ce.hi), addr, slpte,
+    domain_id = VTD_CONTEXT_ENTRY_DID(ce.hi);
+    vtd_update_iotlb(s, source_id, domain_id, addr, slpte,
                      access_flags, level);
+    vtd_update_iotlb_cache(vtd_as, addr, page_mask, slpte, domain_id,
+                           access_flags);
 out:
     entry->iova = addr & page_mask;
     entry->translated_addr = vtd_get_slpte_addr(slpte) & page_mask;
@@ -1300,6 +1372,7 @@ static void vtd_context_device_invalidate(IntelIOMMUState *s,
                 trace_vtd_inv_desc_cc_device(bus_n, VTD_PCI_SLOT(devfn_it),
                                              VTD_PCI_FUNC(devfn_it));
                 vtd_as->context_cache_entry.context_cache_gen = 0;
+                memset(vtd_as->iotlb_cache, 0, sizeof(vtd_as->iotlb_cache));
                 /*
                  * Do switch address space when needed, in case if the
                  * device passthrough bit is switched.
@@ -1366,6 +1439,7 @@ static void vtd_iotlb_domain_invalidate(IntelIOMMUState *s, uint16_t domain_id)
 
     g_hash_table_foreach_remove(s->iotlb, vtd_hash_remove_by_domain,
                                 &domain_id);
+    vtd_iotlb_cache_flush(s);
 
     QLIST_FOREACH(node, &s->notifiers_list, next) {
         vtd_as = node->vtd_as;
@@ -1416,6 +1490,7 @@ static void vtd_iotlb_page_invalidate(IntelIOMMUState *s, uint16_t domain_id,
     info.addr = addr;
     info.mask = ~((1 << am) - 1);
     g_hash_table_foreach_remove(s->iotlb, vtd_hash_remove_by_page, &info);
+    vtd_iotlb_cache_flush(s);
     vtd_iotlb_page_invalidate_notify(s, domain_id, addr, am);
 }
 
@@ -208,6 +208,13 @@ e1000e_nc_receive_iov(NetClientState *nc, const struct iovec *iov, int iovcnt)
     return e1000e_receive_iov(&s->core, iov, iovcnt);
 }
 
+static void
+e1000e_nc_burst(NetClientState *nc, bool begin)
+{
+    E1000EState *s = qemu_get_nic_opaque(nc);
+    e1000e_receive_burst(&s->core, begin);
+}
+
 static ssize_t
 e1000e_nc_receive(NetClientState *nc, const uint8_t *buf, size_t size)
 {
@@ -228,6 +235,7 @@ static NetClientInfo net_e1000e_info = {
     .can_receive = e1000e_nc_can_receive,
     .receive = e1000e_nc_receive,
     .receive_iov = e1000e_nc_receive_iov,
+    .burst = e1000e_nc_burst,
     .link_status_changed = e1000e_set_link_status,
 };
 
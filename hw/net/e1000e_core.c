@@ -1627,6 +1627,17 @@ e1000e_rx_fix_l4_csum(E1000ECore *core, struct NetRxPkt *pkt)
     }
 }
 
+static void
+e1000e_rx_set_interrupt_cause(E1000ECore *core, uint32_t n)
+{
+    if (!e1000e_intrmgr_delay_rx_causes(core, &n)) {
+        trace_e1000e_rx_interrupt_set(n);
+        e1000e_set_interrupt_cause(core, n);
+    } else {
+        trace_e1000e_rx_interrupt_delayed(n);
+    }
+}
+
 ssize_t
 e1000e_receive_iov(E1000ECore *core, const struct iovec *iov, int iovcnt)
 {
@@ -1732,16 +1743,33 @@ e1000e_receive_iov(E1000ECore *core, const struct iovec *iov, int iovcnt)
         trace_e1000e_rx_not_written_to_guest(n);
     }
 
-    if (!e1000e_intrmgr_delay_rx_causes(core, &n)) {
-        trace_e1000e_rx_interrupt_set(n);
-        e1000e_set_interrupt_cause(core, n);
+    if (core->rx_burst) {
+        core->rx_burst_causes |= n;
     } else {
-        trace_e1000e_rx_interrupt_delayed(n);
+        e1000e_rx_set_interrupt_cause(core, n);
     }
 
     return retval;
 }
 
+void
+e1000e_receive_burst(E1000ECore *core, bool begin)
+{
+    uint32_t n = core->rx_burst_causes;
+
+    core->rx_burst = begin;
+    if (begin || !n) {
+        return;
+    }
+
+    /*
+     * Raise the causes collected over the whole burst at once, so that
+     * the delay timers are armed once per burst instead of per packet.
+     */
+    core->rx_burst_causes = 0;
+    e1000e_rx_set_interrupt_cause(core, n);
+}
+
 static inline bool
 e1000e_have_autoneg(E1000ECore *core)
 {
@@ -3445,6 +3473,7 @@ e1000e_core_reset(E1000ECore *core)
     timer_del(core->autoneg_timer);
 
     e1000e_intrmgr_reset(core);
+    core->rx_burst_causes = 0;
 
     memset(core->phy, 0, sizeof core->phy);
     memmove(core->phy, e1000e_phy_reg_init, sizeof e1000e_phy_reg_init);
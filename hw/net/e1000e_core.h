@@ -79,6 +79,10 @@ struct E1000Core {
     bool has_vnet;
     int max_queue_num;
 
+    /* RX interrupt causes collected while the backend delivers a burst */
+    bool rx_burst;
+    uint32_t rx_burst_causes;
+
     /* Interrupt moderation management */
     uint32_t delayed_causes;
 
@@ -145,5 +149,8 @@ e1000e_receive(E1000ECore *core, const uint8_t *buf, size_t size);
 ssize_t
 e1000e_receive_iov(E1000ECore *core, const struct iovec *iov, int iovcnt);
 
+void
+e1000e_receive_burst(E1000ECore *core, bool begin);
+
 void
 e1000e_start_recv(E1000ECore *core);
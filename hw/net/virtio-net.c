@@ -22,6 +22,8 @@
 #include "hw/virtio/virtio-net.h"
 #include "net/vhost_net.h"
 #include "hw/virtio/virtio-bus.h"
+#include "block/aio.h"
+#include "qemu/main-loop.h"
 #include "qapi/qmp/qjson.h"
 #include "qapi-event.h"
 #include "hw/virtio/virtio-access.h"
@@ -40,6 +42,9 @@
 #define VIRTIO_NET_RX_QUEUE_MIN_SIZE VIRTIO_NET_RX_QUEUE_DEFAULT_SIZE
 #define VIRTIO_NET_TX_QUEUE_MIN_SIZE VIRTIO_NET_TX_QUEUE_DEFAULT_SIZE
 
+/* Maximum number of TX buffers popped and completed at once */
+#define VIRTIO_NET_TX_BATCH 32
+
 /*
  * Calculate the number of bytes up to and including the given 'field' of
  * 'container'.
@@ -76,6 +81,29 @@ static int vq2q(int queue_index)
     return queue_index / 2;
 }
 
+static void virtio_net_acquire(VirtIONet *n)
+{
+    if (n->ctx) {
+        aio_context_acquire(n->ctx);
+    }
+}
+
+static void virtio_net_release(VirtIONet *n)
+{
+    if (n->ctx) {
+        aio_context_release(n->ctx);
+    }
+}
+
+static void virtio_net_notify(VirtIONet *n, VirtQueue *vq)
+{
+    if (n->dataplane_started) {
+        virtio_notify_irqfd(VIRTIO_DEVICE(n), vq);
+    } else {
+        virtio_notify(VIRTIO_DEVICE(n), vq);
+    }
+}
+
 /* TODO
  * - we could suppress RX interrupt if we were so inclined.
  */
@@ -182,6 +210,137 @@ static void virtio_net_vhost_status(VirtIONet *n, uint8_t status)
     }
 }
 
+static bool virtio_net_dataplane_handle_output(VirtIODevice *vdev,
+                                               VirtQueue *vq);
+
+/* Context: QEMU global mutex held */
+static int virtio_net_dataplane_start(VirtIONet *n)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int queues = n->multiqueue ? n->max_queues : 1;
+    int nvqs = queues * 2;
+    int i, r;
+
+    /* Take the data queue notifiers away from the main loop, like vhost.
+     * The control queue keeps being handled there.
+     */
+    r = virtio_device_grab_ioeventfd(vdev);
+    if (r < 0) {
+        error_report("virtio-net: unable to grab ioeventfd: %d", -r);
+        return r;
+    }
+
+    r = k->set_guest_notifiers(qbus->parent, nvqs, true);
+    if (r < 0) {
+        error_report("virtio-net: unable to set guest notifiers: %d", -r);
+        goto fail_guest_notifiers;
+    }
+
+    for (i = 0; i < nvqs; i++) {
+        r = virtio_bus_set_host_notifier(VIRTIO_BUS(qbus), i, true);
+        if (r < 0) {
+            error_report("virtio-net: unable to set host notifier: %d", -r);
+            goto fail_host_notifiers;
+        }
+    }
+
+    aio_context_acquire(n->ctx);
+    n->dataplane_nvqs = nvqs;
+    n->dataplane_started = true;
+
+    for (i = 0; i < queues; i++) {
+        NetClientState *nc = qemu_get_subqueue(n->nic, i);
+
+        if (nc->peer) {
+            qemu_net_set_aio_context(nc->peer, n->ctx);
+        }
+    }
+    for (i = 0; i < nvqs; i++) {
+        VirtQueue *vq = virtio_get_queue(vdev, i);
+
+        virtio_queue_aio_set_host_notifier_handler(vq, n->ctx,
+                virtio_net_dataplane_handle_output);
+        /* Kick right away to pick up buffers already in the ring */
+        event_notifier_set(virtio_queue_get_host_notifier(vq));
+    }
+    aio_context_release(n->ctx);
+    return 0;
+
+fail_host_notifiers:
+    while (i--) {
+        virtio_bus_set_host_notifier(VIRTIO_BUS(qbus), i, false);
+    }
+    k->set_guest_notifiers(qbus->parent, nvqs, false);
+fail_guest_notifiers:
+    virtio_device_release_ioeventfd(vdev);
+    return r;
+}
+
+/* Context: QEMU global mutex held */
+static void virtio_net_dataplane_stop(VirtIONet *n)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int nvqs = n->dataplane_nvqs;
+    int i;
+
+    if (n->dataplane_disabled) {
+        n->dataplane_disabled = false;
+        return;
+    }
+
+    /* Hold the lock throughout, so that TX bottom halves and timers in the
+     * IOThread cannot notify the guest while the irqfds go away.
+     */
+    aio_context_acquire(n->ctx);
+    for (i = 0; i < nvqs; i++) {
+        virtio_queue_aio_set_host_notifier_handler(virtio_get_queue(vdev, i),
+                                                   n->ctx, NULL);
+    }
+    for (i = 0; i < nvqs / 2; i++) {
+        NetClientState *nc = qemu_get_subqueue(n->nic, i);
+
+        if (nc->peer) {
+            qemu_net_set_aio_context(nc->peer, NULL);
+        }
+    }
+    for (i = 0; i < nvqs; i++) {
+        virtio_bus_set_host_notifier(VIRTIO_BUS(qbus), i, false);
+    }
+    n->dataplane_started = false;
+    k->set_guest_notifiers(qbus->parent, nvqs, false);
+    aio_context_release(n->ctx);
+
+    virtio_device_release_ioeventfd(vdev);
+}
+
+static void virtio_net_dataplane_status(VirtIONet *n, uint8_t status)
+{
+    bool start;
+
+    if (!n->ctx) {
+        return;
+    }
+
+    start = virtio_net_started(n, status) && !n->vhost_started;
+    if (start == (n->dataplane_started || n->dataplane_disabled)) {
+        return;
+    }
+
+    if (start) {
+        if (virtio_net_dataplane_start(n) < 0) {
+            error_report("virtio-net: unable to start iothread processing, "
+                         "falling back on the main loop");
+            n->dataplane_disabled = true;
+        }
+    } else {
+        virtio_net_dataplane_stop(n);
+    }
+}
+
 static int virtio_net_set_vnet_endian_one(VirtIODevice *vdev,
                                           NetClientState *peer,
                                           bool enable)
@@ -239,7 +398,7 @@ static void virtio_net_drop_tx_queue_data(VirtIODevice *vdev, VirtQueue *vq)
 {
     unsigned int dropped = virtqueue_drop_all(vq);
     if (dropped) {
-        virtio_notify(vdev, vq);
+        virtio_net_notify(VIRTIO_NET(vdev), vq);
     }
 }
 
@@ -252,7 +411,9 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
 
     virtio_net_vnet_endian_status(n, status);
     virtio_net_vhost_status(n, status);
+    virtio_net_dataplane_status(n, status);
 
+    virtio_net_acquire(n);
     for (i = 0; i < n->max_queues; i++) {
         NetClientState *ncs = qemu_get_subqueue(n->nic, i);
         bool queue_started;
@@ -297,6 +458,7 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
             }
         }
     }
+    virtio_net_release(n);
 }
 
 static void virtio_net_set_link_status(NetClientState *nc)
@@ -1270,7 +1432,11 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
     }
 
     virtqueue_flush(q->rx_vq, i);
-    virtio_notify(vdev, q->rx_vq);
+    if (q->rx_burst) {
+        q->rx_notify = true;
+    } else {
+        virtio_net_notify(n, q->rx_vq);
+    }
 
     return size;
 }
@@ -1278,30 +1444,111 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
 static ssize_t virtio_net_receive(NetClientState *nc, const uint8_t *buf,
                                   size_t size)
 {
+    VirtIONet *n = qemu_get_nic_opaque(nc);
     ssize_t r;
 
+    virtio_net_acquire(n);
     rcu_read_lock();
     r = virtio_net_receive_rcu(nc, buf, size);
     rcu_read_unlock();
+    virtio_net_release(n);
     return r;
 }
 
+static void virtio_net_burst(NetClientState *nc, bool begin)
+{
+    VirtIONet *n = qemu_get_nic_opaque(nc);
+    VirtIONetQueue *q = virtio_net_get_subqueue(nc);
+
+    virtio_net_acquire(n);
+    q->rx_burst = begin;
+    if (!begin && q->rx_notify) {
+        q->rx_notify = false;
+        virtio_net_notify(n, q->rx_vq);
+    }
+    virtio_net_release(n);
+}
+
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q);
 
 static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
     VirtIONetQueue *q = virtio_net_get_subqueue(nc);
-    VirtIODevice *vdev = VIRTIO_DEVICE(n);
 
+    virtio_net_acquire(n);
     virtqueue_push(q->tx_vq, q->async_tx.elem, 0);
-    virtio_notify(vdev, q->tx_vq);
+    virtio_net_notify(n, q->tx_vq);
 
     g_free(q->async_tx.elem);
     q->async_tx.elem = NULL;
 
     virtio_queue_set_notification(q->tx_vq, 1);
     virtio_net_flush_tx(q);
+    virtio_net_release(n);
+}
+
+/* Send one packet.  Returns 0 once the packet is done with (sent or
+ * dropped), -EBUSY if the backend queued it, or -EINVAL if the guest
+ * handed us a malformed buffer.
+ */
+static int virtio_net_tx_send(VirtIONetQueue *q, VirtQueueElement *elem)
+{
+    VirtIONet *n = q->n;
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
+    ssize_t ret;
+    unsigned int out_num;
+    struct iovec sg[VIRTQUEUE_MAX_SIZE], sg2[VIRTQUEUE_MAX_SIZE + 1], *out_sg;
+    struct virtio_net_hdr_mrg_rxbuf mhdr;
+
+    out_num = elem->out_num;
+    out_sg = elem->out_sg;
+    if (out_num < 1) {
+        virtio_error(vdev, "virtio-net header not in first element");
+        return -EINVAL;
+    }
+
+    if (n->has_vnet_hdr) {
+        if (iov_to_buf(out_sg, out_num, 0, &mhdr, n->guest_hdr_len) <
+            n->guest_hdr_len) {
+            virtio_error(vdev, "virtio-net header incorrect");
+            return -EINVAL;
+        }
+        if (n->needs_vnet_hdr_swap) {
+            virtio_net_hdr_swap(vdev, (void *) &mhdr);
+            sg2[0].iov_base = &mhdr;
+            sg2[0].iov_len = n->guest_hdr_len;
+            out_num = iov_copy(&sg2[1], ARRAY_SIZE(sg2) - 1,
+                               out_sg, out_num,
+                               n->guest_hdr_len, -1);
+            if (out_num == VIRTQUEUE_MAX_SIZE) {
+                return 0;
+            }
+            out_num += 1;
+            out_sg = sg2;
+        }
+    }
+    /*
+     * If host wants to see the guest header as is, we can
+     * pass it on unchanged. Otherwise, copy just the parts
+     * that host is interested in.
+     */
+    assert(n->host_hdr_len <= n->guest_hdr_len);
+    if (n->host_hdr_len != n->guest_hdr_len) {
+        unsigned sg_num = iov_copy(sg, ARRAY_SIZE(sg),
+                                   out_sg, out_num,
+                                   0, n->host_hdr_len);
+        sg_num += iov_copy(sg + sg_num, ARRAY_SIZE(sg) - sg_num,
+                         out_sg, out_num,
+                         n->guest_hdr_len, -1);
+        out_num = sg_num;
+        out_sg = sg;
+    }
+
+    ret = qemu_sendv_packet_async(qemu_get_subqueue(n->nic, queue_index),
+                                  out_sg, out_num, virtio_net_tx_complete);
+    return ret == 0 ? -EBUSY : 0;
 }
 
 /* TX */
@@ -1309,9 +1556,10 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
 {
     VirtIONet *n = q->n;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
-    VirtQueueElement *elem;
+    VirtQueueElement *elems[VIRTIO_NET_TX_BATCH];
+    unsigned int lens[VIRTIO_NET_TX_BATCH] = {};
     int32_t num_packets = 0;
-    int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
+
     if (!(vdev->status & VIRTIO_CONFIG_S_DRIVER_OK)) {
         return num_packets;
     }
@@ -1321,80 +1569,56 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
         return num_packets;
     }
 
-    for (;;) {
-        ssize_t ret;
-        unsigned int out_num;
-        struct iovec sg[VIRTQUEUE_MAX_SIZE], sg2[VIRTQUEUE_MAX_SIZE + 1], *out_sg;
-        struct virtio_net_hdr_mrg_rxbuf mhdr;
+    while (num_packets < n->tx_burst) {
+        unsigned int i, num;
+        int ret = 0;
 
-        elem = virtqueue_pop(q->tx_vq, sizeof(VirtQueueElement));
-        if (!elem) {
+        num = virtqueue_pop_batch(q->tx_vq, sizeof(VirtQueueElement),
+                                  (void **)elems,
+                                  MIN(ARRAY_SIZE(elems),
+                                      n->tx_burst - num_packets));
+        if (!num) {
             break;
         }
 
-        out_num = elem->out_num;
-        out_sg = elem->out_sg;
-        if (out_num < 1) {
-            virtio_error(vdev, "virtio-net header not in first element");
-            virtqueue_detach_element(q->tx_vq, elem, 0);
-            g_free(elem);
-            return -EINVAL;
-        }
-
-        if (n->has_vnet_hdr) {
-            if (iov_to_buf(out_sg, out_num, 0, &mhdr, n->guest_hdr_len) <
-                n->guest_hdr_len) {
-                virtio_error(vdev, "virtio-net header incorrect");
-                virtqueue_detach_element(q->tx_vq, elem, 0);
-                g_free(elem);
-                return -EINVAL;
+        for (i = 0; i < num; i++) {
+            ret = virtio_net_tx_send(q, elems[i]);
+            if (ret < 0) {
+                break;
             }
-            if (n->needs_vnet_hdr_swap) {
-                virtio_net_hdr_swap(vdev, (void *) &mhdr);
-                sg2[0].iov_base = &mhdr;
-                sg2[0].iov_len = n->guest_hdr_len;
-                out_num = iov_copy(&sg2[1], ARRAY_SIZE(sg2) - 1,
-                                   out_sg, out_num,
-                                   n->guest_hdr_len, -1);
-                if (out_num == VIRTQUEUE_MAX_SIZE) {
-                    goto drop;
-		}
-                out_num += 1;
-                out_sg = sg2;
-	    }
         }
-        /*
-         * If host wants to see the guest header as is, we can
-         * pass it on unchanged. Otherwise, copy just the parts
-         * that host is interested in.
+
+        /* Complete everything that went out with a single used index
+         * update and notification.
          */
-        assert(n->host_hdr_len <= n->guest_hdr_len);
-        if (n->host_hdr_len != n->guest_hdr_len) {
-            unsigned sg_num = iov_copy(sg, ARRAY_SIZE(sg),
-                                       out_sg, out_num,
-                                       0, n->host_hdr_len);
-            sg_num += iov_copy(sg + sg_num, ARRAY_SIZE(sg) - sg_num,
-                             out_sg, out_num,
-                             n->guest_hdr_len, -1);
-            out_num = sg_num;
-            out_sg = sg;
-        }
+        if (i) {
+            unsigned int j;
 
-        ret = qemu_sendv_packet_async(qemu_get_subqueue(n->nic, queue_index),
-                                      out_sg, out_num, virtio_net_tx_complete);
-        if (ret == 0) {
-            virtio_queue_set_notification(q->tx_vq, 0);
-            q->async_tx.elem = elem;
-            return -EBUSY;
+            virtqueue_push_batch(q->tx_vq, elems, lens, i);
+            virtio_net_notify(n, q->tx_vq);
+            for (j = 0; j < i; j++) {
+                g_free(elems[j]);
+            }
+            num_packets += i;
         }
 
-drop:
-        virtqueue_push(q->tx_vq, elem, 0);
-        virtio_notify(vdev, q->tx_vq);
-        g_free(elem);
+        if (ret < 0) {
+            unsigned int j;
 
-        if (++num_packets >= n->tx_burst) {
-            break;
+            /* Give back the packets we did not get to, newest first */
+            for (j = num - 1; j > i; j--) {
+                virtqueue_unpop(q->tx_vq, elems[j], 0);
+                g_free(elems[j]);
+            }
+
+            if (ret == -EBUSY) {
+                virtio_queue_set_notification(q->tx_vq, 0);
+                q->async_tx.elem = elems[i];
+            } else {
+                virtqueue_detach_element(q->tx_vq, elems[i], 0);
+                g_free(elems[i]);
+            }
+            return ret;
         }
     }
     return num_packets;
@@ -1525,31 +1749,146 @@ static void virtio_net_tx_bh(void *opaque)
     }
 }
 
+/* With an iothread, TX bottom halves and timers run there while virtqueue
+ * handlers may run in the main loop, so everything that touches the data
+ * queues takes the AioContext lock.
+ *
+ * When the data queues are not handled by the IOThread, for example because
+ * starting it failed, the backend and the guest notifiers stay in the main
+ * loop, and the bottom halves and timers also need the global mutex.  It is
+ * taken before the AioContext lock, like in the main loop.  Returns true if
+ * the global mutex was taken.
+ */
+static bool virtio_net_iothread_lock(VirtIONet *n)
+{
+    virtio_net_acquire(n);
+    if (n->dataplane_started) {
+        return false;
+    }
+    virtio_net_release(n);
+
+    qemu_mutex_lock_iothread();
+    virtio_net_acquire(n);
+    return true;
+}
+
+static void virtio_net_iothread_unlock(VirtIONet *n, bool locked)
+{
+    virtio_net_release(n);
+    if (locked) {
+        qemu_mutex_unlock_iothread();
+    }
+}
+
+static void virtio_net_iothread_tx_timer(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    bool locked = virtio_net_iothread_lock(q->n);
+
+    virtio_net_tx_timer(q);
+    virtio_net_iothread_unlock(q->n, locked);
+}
+
+static void virtio_net_iothread_tx_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    bool locked = virtio_net_iothread_lock(q->n);
+
+    virtio_net_tx_bh(q);
+    virtio_net_iothread_unlock(q->n, locked);
+}
+
+static void virtio_net_iothread_handle_output(VirtIODevice *vdev,
+                                              VirtQueue *vq)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    VirtIONetQueue *q;
+
+    virtio_net_acquire(n);
+    if (vq == n->ctrl_vq) {
+        virtio_net_handle_ctrl(vdev, vq);
+    } else {
+        q = &n->vqs[vq2q(virtio_get_queue_index(vq))];
+        if (vq == q->rx_vq) {
+            virtio_net_handle_rx(vdev, vq);
+        } else if (q->tx_timer) {
+            virtio_net_handle_tx_timer(vdev, vq);
+        } else {
+            virtio_net_handle_tx_bh(vdev, vq);
+        }
+    }
+    virtio_net_release(n);
+}
+
+static bool virtio_net_dataplane_handle_output(VirtIODevice *vdev,
+                                               VirtQueue *vq)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    bool progress;
+
+    virtio_net_acquire(n);
+    /* RX buffers are only consumed as packets come in from the backend */
+    progress = (virtio_get_queue_index(vq) % 2) && !virtio_queue_empty(vq);
+
+    virtio_net_iothread_handle_output(vdev, vq);
+    virtio_net_release(n);
+    return progress;
+}
+
+static VirtIOHandleOutput virtio_net_vq_handler(VirtIONet *n,
+                                                VirtIOHandleOutput fn)
+{
+    return n->ctx ? virtio_net_iothread_handle_output : fn;
+}
+
 static void virtio_net_add_queue(VirtIONet *n, int index)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
 
-    n->vqs[index].rx_vq = virtio_add_queue(vdev, n->net_conf.rx_queue_size,
-                                           virtio_net_handle_rx);
+    n->vqs[index].rx_vq =
+        virtio_add_queue(vdev, n->net_conf.rx_queue_size,
+                         virtio_net_vq_handler(n, virtio_net_handle_rx));
 
     if (n->net_conf.tx && !strcmp(n->net_conf.tx, "timer")) {
         n->vqs[index].tx_vq =
             virtio_add_queue(vdev, n->net_conf.tx_queue_size,
-                             virtio_net_handle_tx_timer);
-        n->vqs[index].tx_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
-                                              virtio_net_tx_timer,
-                                              &n->vqs[index]);
+                             virtio_net_vq_handler(n,
+                                                   virtio_net_handle_tx_timer));
+        if (n->ctx) {
+            n->vqs[index].tx_timer =
+                aio_timer_new(n->ctx, QEMU_CLOCK_VIRTUAL, SCALE_NS,
+                              virtio_net_iothread_tx_timer, &n->vqs[index]);
+        } else {
+            n->vqs[index].tx_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                                  virtio_net_tx_timer,
+                                                  &n->vqs[index]);
+        }
     } else {
         n->vqs[index].tx_vq =
             virtio_add_queue(vdev, n->net_conf.tx_queue_size,
-                             virtio_net_handle_tx_bh);
-        n->vqs[index].tx_bh = qemu_bh_new(virtio_net_tx_bh, &n->vqs[index]);
+                             virtio_net_vq_handler(n,
+                                                   virtio_net_handle_tx_bh));
+        if (n->ctx) {
+            n->vqs[index].tx_bh = aio_bh_new(n->ctx, virtio_net_iothread_tx_bh,
+                                             &n->vqs[index]);
+        } else {
+            n->vqs[index].tx_bh = qemu_bh_new(virtio_net_tx_bh,
+                                              &n->vqs[index]);
+        }
     }
 
     n->vqs[index].tx_waiting = 0;
     n->vqs[index].n = n;
 }
 
+static void virtio_net_add_ctrl_queue(VirtIONet *n)
+{
+    VirtIOHandleOutput handle_output;
+
+    handle_output = virtio_net_vq_handler(n, virtio_net_handle_ctrl);
+    n->ctrl_vq = virtio_add_queue(VIRTIO_DEVICE(n), 64, handle_output);
+}
+
 static void virtio_net_del_queue(VirtIONet *n, int index)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
@@ -1603,7 +1942,7 @@ static void virtio_net_change_num_queues(VirtIONet *n, int new_max_queues)
     }
 
     /* add ctrl_vq last */
-    n->ctrl_vq = virtio_add_queue(vdev, 64, virtio_net_handle_ctrl);
+    virtio_net_add_ctrl_queue(n);
 }
 
 static void virtio_net_set_multiqueue(VirtIONet *n, int multiqueue)
@@ -1880,6 +2219,7 @@ static NetClientInfo net_virtio_info = {
     .size = sizeof(NICState),
     .can_receive = virtio_net_can_receive,
     .receive = virtio_net_receive,
+    .burst = virtio_net_burst,
     .link_status_changed = virtio_net_set_link_status,
     .query_rx_filter = virtio_net_query_rxfilter,
 };
@@ -1978,6 +2318,42 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
         virtio_cleanup(vdev);
         return;
     }
+
+    if (n->net_conf.iothread) {
+        BusState *qbus = qdev_get_parent_bus(dev);
+        VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+
+        if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
+            error_setg(errp, "device is incompatible with iothread "
+                       "(transport does not support notifiers)");
+            virtio_cleanup(vdev);
+            return;
+        }
+        if (!virtio_device_ioeventfd_enabled(vdev)) {
+            error_setg(errp, "ioeventfd is required for iothread");
+            virtio_cleanup(vdev);
+            return;
+        }
+        for (i = 0; i < n->nic_conf.peers.queues; i++) {
+            NetClientState *peer = n->nic_conf.peers.ncs[i];
+
+            if (peer && !peer->info->set_aio_context) {
+                error_setg(errp, "iothread is only supported with a tap "
+                           "network backend");
+                virtio_cleanup(vdev);
+                return;
+            }
+            /* Filters are driven from the main loop */
+            if (peer && !QTAILQ_EMPTY(&peer->filters)) {
+                error_setg(errp, "netfilters are not supported with "
+                           "iothread");
+                virtio_cleanup(vdev);
+                return;
+            }
+        }
+        n->ctx = iothread_get_aio_context(n->net_conf.iothread);
+    }
+
     n->vqs = g_malloc0(sizeof(VirtIONetQueue) * n->max_queues);
     n->curr_queues = 1;
     n->tx_timeout = n->net_conf.txtimer;
@@ -1997,7 +2373,7 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
         virtio_net_add_queue(n, i);
     }
 
-    n->ctrl_vq = virtio_add_queue(vdev, 64, virtio_net_handle_ctrl);
+    virtio_net_add_ctrl_queue(n);
     qemu_macaddr_default_if_unset(&n->nic_conf.macaddr);
     memcpy(&n->mac[0], &n->nic_conf.macaddr, sizeof(n->mac));
     n->status = VIRTIO_NET_S_LINK_UP;
@@ -2015,6 +2391,12 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
                               object_get_typename(OBJECT(dev)), dev->id, n);
     }
 
+    if (n->ctx) {
+        for (i = 0; i < n->max_queues; i++) {
+            qemu_get_subqueue(n->nic, i)->iothread = true;
+        }
+    }
+
     peer_test_vnet_hdr(n);
     if (peer_has_vnet_hdr(n)) {
         for (i = 0; i < n->max_queues; i++) {
@@ -2152,6 +2534,8 @@ static Property virtio_net_properties[] = {
                        TX_TIMER_INTERVAL),
     DEFINE_PROP_INT32("x-txburst", VirtIONet, net_conf.txburst, TX_BURST),
     DEFINE_PROP_STRING("tx", VirtIONet, net_conf.tx),
+    DEFINE_PROP_LINK("iothread", VirtIONet, net_conf.iothread, TYPE_IOTHREAD,
+                     IOThread *),
     DEFINE_PROP_UINT16("rx_queue_size", VirtIONet, net_conf.rx_queue_size,
                        VIRTIO_NET_RX_QUEUE_DEFAULT_SIZE),
     DEFINE_PROP_UINT16("tx_queue_size", VirtIONet, net_conf.tx_queue_size,
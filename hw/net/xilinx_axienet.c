@@ -826,7 +826,10 @@ static ssize_t eth_rx(NetClientState *nc, const uint8_t *buf, size_t size)
         size = s->c_rxmem - 4;
     }
 
-    memcpy(s->rxmem, buf, size);
+    /* Checksum everything after the ethernet header while copying it.  */
+    memcpy(s->rxmem, buf, MIN(size, 14));
+    csum32 = net_checksum_add_copy(size - 14, (uint8_t *)s->rxmem + 14,
+                                   buf + 14);
     memset(s->rxmem + size, 0, 4); /* Clear the FCS.  */
 
     if (s->rcw[1] & RCW1_FCS) {
@@ -834,7 +837,6 @@ static ssize_t eth_rx(NetClientState *nc, const uint8_t *buf, size_t size)
     }
 
     app[0] = 5 << 28;
-    csum32 = net_checksum_add(size - 14, (uint8_t *)s->rxmem + 14);
     /* Fold it once.  */
     csum32 = (csum32 & 0xffff) + (csum32 >> 16);
     /* And twice to get rid of possible carries.  */
@@ -21,6 +21,41 @@
 #include "hw/virtio/virtio-bus.h"
 #include "hw/virtio/virtio-access.h"
 
+static void virtio_scsi_notify_guest_bh(void *opaque)
+{
+    VirtIOSCSI *s = opaque;
+    VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    unsigned nvqs = VIRTIO_SCSI_COMMON(s)->conf.num_queues + 2;
+    unsigned long bitmap[BITS_TO_LONGS(nvqs)];
+    unsigned j;
+
+    memcpy(bitmap, s->batch_notify_vqs, sizeof(bitmap));
+    memset(s->batch_notify_vqs, 0, sizeof(bitmap));
+
+    for (j = 0; j < nvqs; j += BITS_PER_LONG) {
+        unsigned long bits = bitmap[j / BITS_PER_LONG];
+
+        while (bits != 0) {
+            unsigned i = j + ctzl(bits);
+
+            virtio_notify_irqfd(vdev, virtio_get_queue(vdev, i));
+
+            bits &= bits - 1; /* clear right-most bit */
+        }
+    }
+}
+
+/* Raise an interrupt to signal guest, if necessary.  Requests that complete
+ * together share a single notification.
+ *
+ * Context: s->ctx held
+ */
+void virtio_scsi_dataplane_notify(VirtIOSCSI *s, VirtQueue *vq)
+{
+    set_bit(virtio_get_queue_index(vq), s->batch_notify_vqs);
+    qemu_bh_schedule(s->notify_bh);
+}
+
 /* Context: QEMU global mutex held */
 void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp)
 {
@@ -47,6 +82,20 @@ void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp)
         }
         s->ctx = qemu_get_aio_context();
     }
+
+    s->notify_bh = aio_bh_new(s->ctx, virtio_scsi_notify_guest_bh, s);
+    s->batch_notify_vqs = bitmap_new(vs->conf.num_queues + 2);
+}
+
+/* Context: QEMU global mutex held */
+void virtio_scsi_dataplane_cleanup(VirtIOSCSI *s)
+{
+    if (s->notify_bh) {
+        qemu_bh_delete(s->notify_bh);
+        s->notify_bh = NULL;
+    }
+    g_free(s->batch_notify_vqs);
+    s->batch_notify_vqs = NULL;
 }
 
 static bool virtio_scsi_data_plane_handle_cmd(VirtIODevice *vdev,
@@ -211,6 +260,12 @@ void virtio_scsi_dataplane_stop(VirtIODevice *vdev)
 
     blk_drain_all(); /* ensure there are no in-flight requests */
 
+    /* Deliver batched notifications while the irqfds are still there */
+    aio_context_acquire(s->ctx);
+    qemu_bh_cancel(s->notify_bh);
+    virtio_scsi_notify_guest_bh(s);
+    aio_context_release(s->ctx);
+
     for (i = 0; i < vs->conf.num_queues + 2; i++) {
         virtio_bus_set_host_notifier(VIRTIO_BUS(qbus), i, false);
     }
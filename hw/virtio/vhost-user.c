@@ -34,11 +34,14 @@ enum VhostUserProtocolFeature {
     VHOST_USER_PROTOCOL_F_NET_MTU = 4,
     VHOST_USER_PROTOCOL_F_SLAVE_REQ = 5,
     VHOST_USER_PROTOCOL_F_CROSS_ENDIAN = 6,
+    VHOST_USER_PROTOCOL_F_CONFIGURE_MEM_SLOTS = 15,
 
     VHOST_USER_PROTOCOL_F_MAX
 };
 
-#define VHOST_USER_PROTOCOL_FEATURE_MASK ((1 << VHOST_USER_PROTOCOL_F_MAX) - 1)
+#define VHOST_USER_PROTOCOL_FEATURE_MASK \
+    (((1ULL << (VHOST_USER_PROTOCOL_F_CROSS_ENDIAN + 1)) - 1) | \
+     (1ULL << VHOST_USER_PROTOCOL_F_CONFIGURE_MEM_SLOTS))
 
 typedef enum VhostUserRequest {
     VHOST_USER_NONE = 0,
@@ -65,6 +68,9 @@ typedef enum VhostUserRequest {
     VHOST_USER_SET_SLAVE_REQ_FD = 21,
     VHOST_USER_IOTLB_MSG = 22,
     VHOST_USER_SET_VRING_ENDIAN = 23,
+    VHOST_USER_GET_MAX_MEM_SLOTS = 36,
+    VHOST_USER_ADD_MEM_REG = 37,
+    VHOST_USER_REM_MEM_REG = 38,
     VHOST_USER_MAX
 } VhostUserRequest;
 
@@ -87,6 +93,11 @@ typedef struct VhostUserMemory {
     VhostUserMemoryRegion regions[VHOST_MEMORY_MAX_NREGIONS];
 } VhostUserMemory;
 
+typedef struct VhostUserMemRegMsg {
+    uint64_t padding;
+    VhostUserMemoryRegion region;
+} VhostUserMemRegMsg;
+
 typedef struct VhostUserLog {
     uint64_t mmap_size;
     uint64_t mmap_offset;
@@ -107,6 +118,7 @@ typedef struct VhostUserMsg {
         struct vhost_vring_state state;
         struct vhost_vring_addr addr;
         VhostUserMemory memory;
+        VhostUserMemRegMsg mem_reg;
         VhostUserLog log;
         struct vhost_iotlb_msg iotlb;
     } payload;
@@ -125,6 +137,10 @@ static VhostUserMsg m __attribute__ ((unused));
 struct vhost_user {
     CharBackend *chr;
     int slave_fd;
+    int mem_slots;
+    /* Regions mapped by the backend, with CONFIGURE_MEM_SLOTS */
+    VhostUserMemoryRegion shadow_regions[VHOST_MEMORY_MAX_NREGIONS];
+    int shadow_nregions;
 };
 
 static bool ioeventfd_enabled(void)
@@ -179,35 +195,43 @@ fail:
     return -1;
 }
 
-static int process_message_reply(struct vhost_dev *dev,
-                                 const VhostUserMsg *msg)
+static int vhost_user_read_ack(struct vhost_dev *dev,
+                               VhostUserRequest request)
 {
     VhostUserMsg msg_reply;
 
-    if ((msg->flags & VHOST_USER_NEED_REPLY_MASK) == 0) {
-        return 0;
-    }
-
     if (vhost_user_read(dev, &msg_reply) < 0) {
         return -1;
     }
 
-    if (msg_reply.request != msg->request) {
+    if (msg_reply.request != request) {
         error_report("Received unexpected msg type."
                      "Expected %d received %d",
-                     msg->request, msg_reply.request);
+                     request, msg_reply.request);
         return -1;
     }
 
     return msg_reply.payload.u64 ? -1 : 0;
 }
 
+static int process_message_reply(struct vhost_dev *dev,
+                                 const VhostUserMsg *msg)
+{
+    if ((msg->flags & VHOST_USER_NEED_REPLY_MASK) == 0) {
+        return 0;
+    }
+
+    return vhost_user_read_ack(dev, msg->request);
+}
+
 static bool vhost_user_one_time_request(VhostUserRequest request)
 {
     switch (request) {
     case VHOST_USER_SET_OWNER:
     case VHOST_USER_RESET_OWNER:
     case VHOST_USER_SET_MEM_TABLE:
+    case VHOST_USER_ADD_MEM_REG:
+    case VHOST_USER_REM_MEM_REG:
     case VHOST_USER_GET_QUEUE_NUM:
     case VHOST_USER_NET_SET_MTU:
         return true;
@@ -289,23 +313,12 @@ static int vhost_user_set_log_base(struct vhost_dev *dev, uint64_t base,
     return 0;
 }
 
-static int vhost_user_set_mem_table(struct vhost_dev *dev,
-                                    struct vhost_memory *mem)
+static size_t vhost_user_fill_mem_regions(struct vhost_dev *dev,
+                                          VhostUserMemoryRegion *regions,
+                                          int *fds)
 {
-    int fds[VHOST_MEMORY_MAX_NREGIONS];
     int i, fd;
     size_t fd_num = 0;
-    bool reply_supported = virtio_has_feature(dev->protocol_features,
-                                              VHOST_USER_PROTOCOL_F_REPLY_ACK);
-
-    VhostUserMsg msg = {
-        .request = VHOST_USER_SET_MEM_TABLE,
-        .flags = VHOST_USER_VERSION,
-    };
-
-    if (reply_supported) {
-        msg.flags |= VHOST_USER_NEED_REPLY_MASK;
-    }
 
     for (i = 0; i < dev->mem->nregions; ++i) {
         struct vhost_memory_region *reg = dev->mem->regions + i;
@@ -317,15 +330,141 @@ static int vhost_user_set_mem_table(struct vhost_dev *dev,
                                      &offset);
         fd = memory_region_get_fd(mr);
         if (fd > 0) {
-            msg.payload.memory.regions[fd_num].userspace_addr = reg->userspace_addr;
-            msg.payload.memory.regions[fd_num].memory_size  = reg->memory_size;
-            msg.payload.memory.regions[fd_num].guest_phys_addr = reg->guest_phys_addr;
-            msg.payload.memory.regions[fd_num].mmap_offset = offset;
+            regions[fd_num].userspace_addr = reg->userspace_addr;
+            regions[fd_num].memory_size  = reg->memory_size;
+            regions[fd_num].guest_phys_addr = reg->guest_phys_addr;
+            regions[fd_num].mmap_offset = offset;
             assert(fd_num < VHOST_MEMORY_MAX_NREGIONS);
             fds[fd_num++] = fd;
         }
     }
 
+    return fd_num;
+}
+
+static bool vhost_user_has_mem_region(const VhostUserMemoryRegion *regions,
+                                      int nregions,
+                                      const VhostUserMemoryRegion *reg)
+{
+    int i;
+
+    for (i = 0; i < nregions; i++) {
+        if (!memcmp(&regions[i], reg, sizeof(*reg))) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int vhost_user_send_mem_reg(struct vhost_dev *dev,
+                                   VhostUserRequest request,
+                                   const VhostUserMemoryRegion *reg, int fd,
+                                   bool *need_reply)
+{
+    bool reply_supported = virtio_has_feature(dev->protocol_features,
+                                              VHOST_USER_PROTOCOL_F_REPLY_ACK);
+    VhostUserMsg msg = {
+        .request = request,
+        .flags = VHOST_USER_VERSION,
+        .payload.mem_reg.region = *reg,
+        .size = sizeof(msg.payload.mem_reg),
+    };
+
+    if (reply_supported) {
+        msg.flags |= VHOST_USER_NEED_REPLY_MASK;
+    }
+
+    if (vhost_user_write(dev, &msg, fd < 0 ? NULL : &fd, fd < 0 ? 0 : 1) < 0) {
+        return -1;
+    }
+
+    *need_reply = msg.flags & VHOST_USER_NEED_REPLY_MASK;
+    return 0;
+}
+
+/*
+ * Bring the backend's memory map in line with @regions by sending only
+ * the regions that went away and the ones that appeared, instead of the
+ * whole table. All the messages are written before any acknowledgement
+ * is read back, so the backend can process them without a round trip
+ * per region.
+ */
+static int vhost_user_update_mem_regions(struct vhost_dev *dev,
+                                         const VhostUserMemoryRegion *regions,
+                                         const int *fds, int nregions)
+{
+    struct vhost_user *u = dev->opaque;
+    VhostUserRequest pending[2 * VHOST_MEMORY_MAX_NREGIONS];
+    int npending = 0;
+    bool need_reply;
+    int i;
+
+    /* Remove first, so that the slots are free for the new regions */
+    for (i = 0; i < u->shadow_nregions;) {
+        VhostUserMemoryRegion *reg = &u->shadow_regions[i];
+
+        if (vhost_user_has_mem_region(regions, nregions, reg)) {
+            i++;
+            continue;
+        }
+
+        if (vhost_user_send_mem_reg(dev, VHOST_USER_REM_MEM_REG, reg, -1,
+                                    &need_reply) < 0) {
+            return -1;
+        }
+        if (need_reply) {
+            pending[npending++] = VHOST_USER_REM_MEM_REG;
+        }
+
+        *reg = u->shadow_regions[--u->shadow_nregions];
+    }
+
+    for (i = 0; i < nregions; i++) {
+        if (vhost_user_has_mem_region(u->shadow_regions, u->shadow_nregions,
+                                      &regions[i])) {
+            continue;
+        }
+
+        if (vhost_user_send_mem_reg(dev, VHOST_USER_ADD_MEM_REG, &regions[i],
+                                    fds[i], &need_reply) < 0) {
+            return -1;
+        }
+        if (need_reply) {
+            pending[npending++] = VHOST_USER_ADD_MEM_REG;
+        }
+
+        u->shadow_regions[u->shadow_nregions++] = regions[i];
+    }
+
+    for (i = 0; i < npending; i++) {
+        if (vhost_user_read_ack(dev, pending[i]) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int vhost_user_set_mem_table(struct vhost_dev *dev,
+                                    struct vhost_memory *mem)
+{
+    int fds[VHOST_MEMORY_MAX_NREGIONS];
+    size_t fd_num;
+    bool reply_supported = virtio_has_feature(dev->protocol_features,
+                                              VHOST_USER_PROTOCOL_F_REPLY_ACK);
+
+    VhostUserMsg msg = {
+        .request = VHOST_USER_SET_MEM_TABLE,
+        .flags = VHOST_USER_VERSION,
+    };
+
+    if (reply_supported) {
+        msg.flags |= VHOST_USER_NEED_REPLY_MASK;
+    }
+
+    fd_num = vhost_user_fill_mem_regions(dev, msg.payload.memory.regions, fds);
+
     msg.payload.memory.nregions = fd_num;
 
     if (!fd_num) {
@@ -334,6 +473,12 @@ static int vhost_user_set_mem_table(struct vhost_dev *dev,
         return -1;
     }
 
+    if (virtio_has_feature(dev->protocol_features,
+                           VHOST_USER_PROTOCOL_F_CONFIGURE_MEM_SLOTS)) {
+        return vhost_user_update_mem_regions(dev, msg.payload.memory.regions,
+                                             fds, fd_num);
+    }
+
     msg.size = sizeof(msg.payload.memory.nregions);
     msg.size += sizeof(msg.payload.memory.padding);
     msg.size += fd_num * sizeof(VhostUserMemoryRegion);
@@ -596,6 +741,7 @@ static int vhost_user_set_owner(struct vhost_dev *dev)
 
 static int vhost_user_reset_device(struct vhost_dev *dev)
 {
+    struct vhost_user *u = dev->opaque;
     VhostUserMsg msg = {
         .request = VHOST_USER_RESET_OWNER,
         .flags = VHOST_USER_VERSION,
@@ -605,6 +751,8 @@ static int vhost_user_reset_device(struct vhost_dev *dev)
         return -1;
     }
 
+    /* The backend forgets its memory map along with the owner */
+    u->shadow_nregions = 0;
     return 0;
 }
 
@@ -731,6 +879,7 @@ static int vhost_user_init(struct vhost_dev *dev, void *opaque)
     u = g_new0(struct vhost_user, 1);
     u->chr = opaque;
     u->slave_fd = -1;
+    u->mem_slots = VHOST_MEMORY_MAX_NREGIONS;
     dev->opaque = u;
 
     err = vhost_user_get_features(dev, &features);
@@ -763,6 +912,18 @@ static int vhost_user_init(struct vhost_dev *dev, void *opaque)
             }
         }
 
+        if (virtio_has_feature(dev->protocol_features,
+                               VHOST_USER_PROTOCOL_F_CONFIGURE_MEM_SLOTS)) {
+            uint64_t ram_slots;
+
+            err = vhost_user_get_u64(dev, VHOST_USER_GET_MAX_MEM_SLOTS,
+                                     &ram_slots);
+            if (err < 0) {
+                return err;
+            }
+            u->mem_slots = MIN(ram_slots, VHOST_MEMORY_MAX_NREGIONS);
+        }
+
         if (virtio_has_feature(features, VIRTIO_F_IOMMU_PLATFORM) &&
                 !(virtio_has_feature(dev->protocol_features,
                     VHOST_USER_PROTOCOL_F_SLAVE_REQ) &&
@@ -817,7 +978,9 @@ static int vhost_user_get_vq_index(struct vhost_dev *dev, int idx)
 
 static int vhost_user_memslots_limit(struct vhost_dev *dev)
 {
-    return VHOST_MEMORY_MAX_NREGIONS;
+    struct vhost_user *u = dev->opaque;
+
+    return u->mem_slots;
 }
 
 static bool vhost_user_requires_shm_log(struct vhost_dev *dev)
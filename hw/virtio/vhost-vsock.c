@@ -22,6 +22,11 @@
 #include "qemu/iov.h"
 #include "monitor/monitor.h"
 
+/* Features supported by host kernel. */
+static const int kernel_feature_bits[] = {
+    VHOST_INVALID_FEATURE_BIT
+};
+
 enum {
     VHOST_VSOCK_SAVEVM_VERSION = 0,
 
@@ -178,8 +183,13 @@ static uint64_t vhost_vsock_get_features(VirtIODevice *vdev,
                                          uint64_t requested_features,
                                          Error **errp)
 {
-    /* No feature bits used yet */
-    return requested_features;
+    VHostVSock *vsock = VHOST_VSOCK(vdev);
+
+    /* No device feature bits used yet, but vhost_get_features() masks
+     * the transport features that vhost cannot support.
+     */
+    return vhost_get_features(&vsock->vhost_dev, kernel_feature_bits,
+                              requested_features);
 }
 
 static void vhost_vsock_handle_output(VirtIODevice *vdev, VirtQueue *vq)
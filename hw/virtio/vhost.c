@@ -1485,6 +1485,12 @@ uint64_t vhost_get_features(struct vhost_dev *hdev, const int *feature_bits,
         }
         bit++;
     }
+
+    /* The vring base exchanged with the backend on start, stop and
+     * migration does not carry the packed ring wrap counters, so never
+     * offer the packed layout, even to a backend that supports it.
+     */
+    features &= ~(1ULL << VIRTIO_F_RING_PACKED);
     return features;
 }
 
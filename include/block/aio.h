@@ -139,10 +139,20 @@ struct AioContext {
     int64_t poll_max_ns;    /* maximum polling time in nanoseconds */
     int64_t poll_grow;      /* polling time growth factor */
     int64_t poll_shrink;    /* polling time shrink factor */
+    int64_t poll_idle_ns;   /* stop polling handlers idle for this long */
 
     /* Are we in polling mode or monitoring file descriptors? */
     bool poll_started;
 
+    /* Busy polling statistics, only updated by the AioContext's thread */
+    uint64_t poll_hits;     /* busy polling made progress */
+    uint64_t poll_misses;   /* busy polling timed out */
+    uint64_t poll_busy_ns;  /* time spent busy polling */
+
+    /* Thread pool size limits, applied by thread_pool_update_params() */
+    int64_t thread_pool_min;
+    int64_t thread_pool_max;
+
     /* epoll(7) state used when built with CONFIG_EPOLL */
     int epollfd;
     bool epoll_enabled;
@@ -564,4 +574,15 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
                                  int64_t grow, int64_t shrink,
                                  Error **errp);
 
+/**
+ * aio_context_set_thread_pool_params:
+ * @ctx: the aio context
+ * @min: number of worker threads that are kept running even when idle
+ * @max: maximum number of worker threads
+ *
+ * Worker threads up to @min are spawned as soon as the thread pool exists.
+ */
+void aio_context_set_thread_pool_params(AioContext *ctx, int64_t min,
+                                        int64_t max, Error **errp);
+
 #endif
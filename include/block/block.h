@@ -501,6 +501,13 @@ int bdrv_save_vmstate(BlockDriverState *bs, const uint8_t *buf,
 int bdrv_load_vmstate(BlockDriverState *bs, uint8_t *buf,
                       int64_t pos, int size);
 
+typedef struct BdrvVMStateIO BdrvVMStateIO;
+BdrvVMStateIO *bdrv_vmstate_io_new(BlockDriverState *bs, bool is_read);
+int bdrv_vmstate_io_writev(BdrvVMStateIO *s, QEMUIOVector *qiov, int64_t pos);
+int bdrv_vmstate_io_read(BdrvVMStateIO *s, uint8_t *buf, int64_t pos,
+                         int size);
+int bdrv_vmstate_io_close(BdrvVMStateIO *s);
+
 void bdrv_img_create(const char *filename, const char *fmt,
                      const char *base_filename, const char *base_fmt,
                      char *options, uint64_t img_size, int flags,
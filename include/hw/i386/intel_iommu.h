@@ -60,6 +60,7 @@ typedef struct VTDContextCacheEntry VTDContextCacheEntry;
 typedef struct IntelIOMMUState IntelIOMMUState;
 typedef struct VTDAddressSpace VTDAddressSpace;
 typedef struct VTDIOTLBEntry VTDIOTLBEntry;
+typedef struct VTDIOTLBCacheEntry VTDIOTLBCacheEntry;
 typedef struct VTDBus VTDBus;
 typedef union VTD_IR_TableEntry VTD_IR_TableEntry;
 typedef union VTD_IR_MSIAddress VTD_IR_MSIAddress;
@@ -81,6 +82,23 @@ struct VTDContextCacheEntry {
     struct VTDContextEntry context_entry;
 };
 
+/* Number of translations cached per device, must be a power of 2 */
+#define VTD_IOTLB_CACHE_SIZE        16
+
+/* Per-device copy of recently used IOTLB entries, checked before the
+ * IOMMU-wide IOTLB hash table.  An entry is valid only while its @gen
+ * matches IntelIOMMUState.iotlb_gen, so every IOTLB invalidation drops
+ * all per-device entries at once.
+ */
+struct VTDIOTLBCacheEntry {
+    uint64_t gen;
+    hwaddr iova;                /* Page address, i.e. masked with @mask */
+    uint64_t mask;
+    uint64_t slpte;
+    uint16_t domain_id;
+    uint8_t access_flags;
+};
+
 struct VTDAddressSpace {
     PCIBus *bus;
     uint8_t devfn;
@@ -91,6 +109,7 @@ struct VTDAddressSpace {
     MemoryRegion iommu_ir;      /* Interrupt region: 0xfeeXXXXX */
     IntelIOMMUState *iommu_state;
     VTDContextCacheEntry context_cache_entry;
+    VTDIOTLBCacheEntry iotlb_cache[VTD_IOTLB_CACHE_SIZE];
 };
 
 struct VTDBus {
@@ -289,6 +308,7 @@ struct IntelIOMMUState {
 
     uint32_t context_cache_gen;     /* Should be in [1,MAX] */
     GHashTable *iotlb;              /* IOTLB */
+    uint64_t iotlb_gen;             /* Generation of per-device IOTLB caches */
 
     GHashTable *vtd_as_by_busptr;   /* VTDBus objects indexed by PCIBus* reference */
     VTDBus *vtd_as_by_bus_num[VTD_PCI_BUS_MAX]; /* VTDBus objects indexed by bus number */
@@ -56,6 +56,7 @@ typedef struct VirtIOBlock {
     bool dataplane_disabled;
     bool dataplane_started;
     struct VirtIOBlockDataPlane *dataplane;
+    uint64_t *vq_requests;      /* requests popped, per virtqueue */
 } VirtIOBlock;
 
 typedef struct VirtIOBlockReq {
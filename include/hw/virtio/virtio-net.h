@@ -16,6 +16,7 @@
 
 #include "standard-headers/linux/virtio_net.h"
 #include "hw/virtio/virtio.h"
+#include "sysemu/iothread.h"
 
 #define TYPE_VIRTIO_NET "virtio-net-device"
 #define VIRTIO_NET(obj) \
@@ -38,6 +39,7 @@ typedef struct virtio_net_conf
     uint16_t rx_queue_size;
     uint16_t tx_queue_size;
     uint16_t mtu;
+    IOThread *iothread;
 } virtio_net_conf;
 
 /* Maximum packet size we can receive from tap device: header + 64k */
@@ -49,6 +51,8 @@ typedef struct VirtIONetQueue {
     QEMUTimer *tx_timer;
     QEMUBH *tx_bh;
     uint32_t tx_waiting;
+    bool rx_burst;      /* the backend is delivering a run of packets */
+    bool rx_notify;     /* guest notification deferred to the end of it */
     struct {
         VirtQueueElement *elem;
     } async_tx;
@@ -77,6 +81,10 @@ typedef struct VirtIONet {
     uint8_t nouni;
     uint8_t nobcast;
     uint8_t vhost_started;
+    AioContext *ctx; /* one iothread per virtio-net device for now */
+    bool dataplane_started;
+    bool dataplane_disabled;
+    int dataplane_nvqs;
     struct {
         uint32_t in_use;
         uint32_t first_multi;
@@ -0,0 +1,43 @@
+/*
+ * Virtio packed virtqueue layout
+ *
+ * Definitions from the VIRTIO 1.1 specification that the imported Linux
+ * headers do not carry yet.  Drop them once scripts/update-linux-headers.sh
+ * brings in a virtio_config.h and virtio_ring.h that have them.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_VIRTIO_RING_PACKED_H
+#define QEMU_VIRTIO_RING_PACKED_H
+
+/* This feature indicates support for the packed virtqueue layout. */
+#ifndef VIRTIO_F_RING_PACKED
+#define VIRTIO_F_RING_PACKED            34
+#endif
+
+/*
+ * Mark a descriptor as available or used in packed ring.
+ * Notice: they are defined as shifts instead of shifted values.
+ */
+#ifndef VRING_PACKED_DESC_F_AVAIL
+#define VRING_PACKED_DESC_F_AVAIL       7
+#define VRING_PACKED_DESC_F_USED        15
+
+/* Enable events in packed ring. */
+#define VRING_PACKED_EVENT_FLAG_ENABLE  0x0
+/* Disable events in packed ring. */
+#define VRING_PACKED_EVENT_FLAG_DISABLE 0x1
+/*
+ * Enable events for a specific descriptor in packed ring
+ * (as specified by Descriptor Ring Change Event Offset/Wrap Counter).
+ * Only valid if VIRTIO_RING_F_EVENT_IDX has been negotiated.
+ */
+#define VRING_PACKED_EVENT_FLAG_DESC    0x2
+
+/* Wrap counter bit shift in event suppression structure of packed ring. */
+#define VRING_PACKED_EVENT_F_WRAP_CTR   15
+#endif
+
+#endif
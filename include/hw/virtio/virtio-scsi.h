@@ -86,6 +86,8 @@ typedef struct VirtIOSCSI {
     bool dataplane_starting;
     bool dataplane_stopping;
     bool dataplane_fenced;
+    QEMUBH *notify_bh;
+    unsigned long *batch_notify_vqs;
     uint32_t host_features;
 } VirtIOSCSI;
 
@@ -155,6 +157,8 @@ void virtio_scsi_push_event(VirtIOSCSI *s, SCSIDevice *dev,
                             uint32_t event, uint32_t reason);
 
 void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp);
+void virtio_scsi_dataplane_cleanup(VirtIOSCSI *s);
+void virtio_scsi_dataplane_notify(VirtIOSCSI *s, VirtQueue *vq);
 int virtio_scsi_dataplane_start(VirtIODevice *s);
 void virtio_scsi_dataplane_stop(VirtIODevice *s);
 
@@ -22,10 +22,13 @@
 struct iovec;
 
 uint32_t net_checksum_add_cont(int len, uint8_t *buf, int seq);
+uint32_t net_checksum_add_copy_cont(int len, uint8_t *dst, const uint8_t *src,
+                                    int seq);
 uint16_t net_checksum_finish(uint32_t sum);
 uint16_t net_checksum_tcpudp(uint16_t length, uint16_t proto,
                              uint8_t *addrs, uint8_t *buf);
 void net_checksum_calculate(uint8_t *data, int length);
+bool test_net_checksum_next_accel(void);
 
 static inline uint32_t
 net_checksum_add(int len, uint8_t *buf)
@@ -33,6 +36,19 @@ net_checksum_add(int len, uint8_t *buf)
     return net_checksum_add_cont(len, buf, 0);
 }
 
+/**
+ * net_checksum_add_copy: copy a buffer and checksum it in one pass
+ *
+ * Equivalent to memcpy(@dst, @src, @len) followed by
+ * net_checksum_add(@len, @dst), but only reads the data once.
+ * Nothing is copied if @len is not positive.
+ */
+static inline uint32_t
+net_checksum_add_copy(int len, uint8_t *dst, const uint8_t *src)
+{
+    return net_checksum_add_copy_cont(len, dst, src, 0);
+}
+
 static inline uint16_t
 net_raw_checksum(uint8_t *data, int length)
 {
@@ -117,6 +117,27 @@ bool qemu_in_coroutine(void);
  */
 bool qemu_coroutine_entered(Coroutine *co);
 
+/**
+ * Grow or shrink the number of coroutines kept in the pools
+ *
+ * Devices that can have many requests in flight, each running in its own
+ * coroutine, should increase the pool size by their maximum concurrency
+ * when they are realized, and decrease it by the same amount when they go
+ * away.  Otherwise coroutines freed beyond the default pool size release
+ * their stack, and the next burst of requests allocates it again.
+ */
+void qemu_coroutine_increase_pool_batch_size(unsigned int additional_size);
+void qemu_coroutine_decrease_pool_batch_size(unsigned int removed_size);
+
+typedef struct CoroutinePoolStats {
+    unsigned long allocated;    /* coroutines created with a new stack */
+    unsigned long freed;        /* coroutines whose stack was released */
+    unsigned long refills;      /* batches moved to a thread's local pool */
+    unsigned int batch_size;
+} CoroutinePoolStats;
+
+void qemu_coroutine_get_pool_stats(CoroutinePoolStats *stats);
+
 /**
  * Provides a mutex that can be used to synchronise coroutines
  */
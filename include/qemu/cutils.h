@@ -154,6 +154,8 @@ int qemu_strtosz_metric(const char *nptr, char **end, uint64_t *result);
 #define STR_OR_NULL(str) ((str) ? (str) : "null")
 
 bool buffer_is_zero(const void *buf, size_t len);
+size_t buffer_is_zero_run(const void *buf, size_t chunk, size_t n,
+                          bool *is_zero);
 bool test_buffer_is_zero_next_accel(void);
 
 /*
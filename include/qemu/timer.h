@@ -66,7 +66,8 @@ struct QEMUTimer {
     QEMUTimerList *timer_list;
     QEMUTimerCB *cb;
     void *opaque;
-    QEMUTimer *next;
+    uint64_t seq;               /* orders timers with the same expire_time */
+    size_t heap_index;          /* position in the timer list, if pending */
     int scale;
 };
 
@@ -36,6 +36,10 @@ typedef struct {
     int64_t poll_max_ns;
     int64_t poll_grow;
     int64_t poll_shrink;
+
+    /* Thread pool parameters */
+    int64_t thread_pool_min;
+    int64_t thread_pool_max;
 } IOThread;
 
 #define IOTHREAD(obj) \
@@ -20,6 +20,8 @@ typedef struct KVMSlot
     void *ram;
     int slot;
     int flags;
+    /* Dirty bitmap buffer for KVM_GET_DIRTY_LOG, kept across syncs */
+    unsigned long *dirty_bmap;
 } KVMSlot;
 
 typedef struct KVMMemoryListener {
@@ -17,6 +17,7 @@
 #include "qemu/module.h"
 #include "block/aio.h"
 #include "block/block.h"
+#include "block/thread-pool.h"
 #include "sysemu/iothread.h"
 #include "qmp-commands.h"
 #include "qemu/error-report.h"
@@ -108,6 +109,7 @@ static void iothread_instance_init(Object *obj)
     IOThread *iothread = IOTHREAD(obj);
 
     iothread->poll_max_ns = IOTHREAD_POLL_MAX_NS_DEFAULT;
+    iothread->thread_pool_max = THREAD_POOL_MAX_THREADS_DEFAULT;
 }
 
 static void iothread_instance_finalize(Object *obj)
@@ -153,6 +155,22 @@ static void iothread_complete(UserCreatable *obj, Error **errp)
         return;
     }
 
+    aio_context_set_thread_pool_params(iothread->ctx,
+                                       iothread->thread_pool_min,
+                                       iothread->thread_pool_max,
+                                       &local_error);
+    if (local_error) {
+        error_propagate(errp, local_error);
+        aio_context_unref(iothread->ctx);
+        iothread->ctx = NULL;
+        return;
+    }
+
+    /* Create the pool now so that min_threads workers are ready early */
+    if (iothread->thread_pool_min) {
+        aio_get_thread_pool(iothread->ctx);
+    }
+
     qemu_mutex_init(&iothread->init_done_lock);
     qemu_cond_init(&iothread->init_done_cond);
     iothread->once = (GOnce) G_ONCE_INIT;
@@ -179,23 +197,29 @@ static void iothread_complete(UserCreatable *obj, Error **errp)
 typedef struct {
     const char *name;
     ptrdiff_t offset; /* field's byte offset in IOThread struct */
-} PollParamInfo;
+} IOThreadParamInfo;
 
-static PollParamInfo poll_max_ns_info = {
+static IOThreadParamInfo poll_max_ns_info = {
     "poll-max-ns", offsetof(IOThread, poll_max_ns),
 };
-static PollParamInfo poll_grow_info = {
+static IOThreadParamInfo poll_grow_info = {
     "poll-grow", offsetof(IOThread, poll_grow),
 };
-static PollParamInfo poll_shrink_info = {
+static IOThreadParamInfo poll_shrink_info = {
     "poll-shrink", offsetof(IOThread, poll_shrink),
 };
+static IOThreadParamInfo thread_pool_min_info = {
+    "thread-pool-min", offsetof(IOThread, thread_pool_min),
+};
+static IOThreadParamInfo thread_pool_max_info = {
+    "thread-pool-max", offsetof(IOThread, thread_pool_max),
+};
 
-static void iothread_get_poll_param(Object *obj, Visitor *v,
+static void iothread_get_param(Object *obj, Visitor *v,
         const char *name, void *opaque, Error **errp)
 {
     IOThread *iothread = IOTHREAD(obj);
-    PollParamInfo *info = opaque;
+    IOThreadParamInfo *info = opaque;
     int64_t *field = (void *)iothread + info->offset;
 
     visit_type_int64(v, name, field, errp);
@@ -205,7 +229,7 @@ static void iothread_set_poll_param(Object *obj, Visitor *v,
         const char *name, void *opaque, Error **errp)
 {
     IOThread *iothread = IOTHREAD(obj);
-    PollParamInfo *info = opaque;
+    IOThreadParamInfo *info = opaque;
     int64_t *field = (void *)iothread + info->offset;
     Error *local_err = NULL;
     int64_t value;
@@ -235,23 +259,71 @@ out:
     error_propagate(errp, local_err);
 }
 
+static void iothread_set_thread_pool_param(Object *obj, Visitor *v,
+        const char *name, void *opaque, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+    IOThreadParamInfo *info = opaque;
+    int64_t *field = (void *)iothread + info->offset;
+    Error *local_err = NULL;
+    int64_t value;
+
+    visit_type_int64(v, name, &value, &local_err);
+    if (local_err) {
+        goto out;
+    }
+
+    if (value < 0 || value > INT_MAX) {
+        error_setg(&local_err, "%s value must be in range [0, %d]",
+                   info->name, INT_MAX);
+        goto out;
+    }
+
+    if (iothread->ctx) {
+        int64_t old_value = *field;
+
+        *field = value;
+        aio_context_set_thread_pool_params(iothread->ctx,
+                                           iothread->thread_pool_min,
+                                           iothread->thread_pool_max,
+                                           &local_err);
+        if (local_err) {
+            /* Do not report limits that were not applied */
+            *field = old_value;
+        }
+    } else {
+        *field = value;
+    }
+
+out:
+    error_propagate(errp, local_err);
+}
+
 static void iothread_class_init(ObjectClass *klass, void *class_data)
 {
     UserCreatableClass *ucc = USER_CREATABLE_CLASS(klass);
     ucc->complete = iothread_complete;
 
     object_class_property_add(klass, "poll-max-ns", "int",
-                              iothread_get_poll_param,
+                              iothread_get_param,
                               iothread_set_poll_param,
                               NULL, &poll_max_ns_info, &error_abort);
     object_class_property_add(klass, "poll-grow", "int",
-                              iothread_get_poll_param,
+                              iothread_get_param,
                               iothread_set_poll_param,
                               NULL, &poll_grow_info, &error_abort);
     object_class_property_add(klass, "poll-shrink", "int",
-                              iothread_get_poll_param,
+                              iothread_get_param,
                               iothread_set_poll_param,
                               NULL, &poll_shrink_info, &error_abort);
+    object_class_property_add(klass, "thread-pool-min", "int",
+                              iothread_get_param,
+                              iothread_set_thread_pool_param,
+                              NULL, &thread_pool_min_info, &error_abort);
+    object_class_property_add(klass, "thread-pool-max", "int",
+                              iothread_get_param,
+                              iothread_set_thread_pool_param,
+                              NULL, &thread_pool_max_info, &error_abort);
 }
 
 static const TypeInfo iothread_info = {
@@ -290,6 +362,7 @@ static int query_one_iothread(Object *object, void *opaque)
     IOThreadInfoList *elem;
     IOThreadInfo *info;
     IOThread *iothread;
+    ThreadPool *pool;
 
     iothread = (IOThread *)object_dynamic_cast(object, TYPE_IOTHREAD);
     if (!iothread) {
@@ -302,6 +375,25 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_max_ns = iothread->poll_max_ns;
     info->poll_grow = iothread->poll_grow;
     info->poll_shrink = iothread->poll_shrink;
+    if (iothread->ctx) {
+        /* Read without synchronization, the values may be slightly stale */
+        info->poll_hits = iothread->ctx->poll_hits;
+        info->poll_misses = iothread->ctx->poll_misses;
+        info->poll_busy_ns = iothread->ctx->poll_busy_ns;
+    }
+    info->thread_pool_min = iothread->thread_pool_min;
+    info->thread_pool_max = iothread->thread_pool_max;
+
+    pool = iothread->ctx ? atomic_read(&iothread->ctx->thread_pool) : NULL;
+    if (pool) {
+        ThreadPoolStats stats;
+
+        thread_pool_get_stats(pool, &stats);
+        info->thread_pool_threads = stats.threads;
+        info->thread_pool_idle_threads = stats.idle_threads;
+        info->thread_pool_requests = stats.requests;
+        info->thread_pool_steals = stats.steals;
+    }
 
     elem = g_new0(IOThreadInfoList, 1);
     elem->value = info;
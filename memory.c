@@ -38,7 +38,9 @@
 
 static unsigned memory_region_transaction_depth;
 static bool memory_region_update_pending;
+static bool memory_region_update_all;
 static bool ioeventfd_update_pending;
+static GHashTable *memory_region_update_set;
 static bool global_dirty_log = false;
 
 static QTAILQ_HEAD(memory_listeners, MemoryListener) memory_listeners
@@ -49,6 +51,32 @@ static QTAILQ_HEAD(, AddressSpace) address_spaces
 
 static GHashTable *flat_views;
 
+/* Record that @mr changed in a way that affects rendering.  Only FlatViews
+ * whose tree reaches one of the recorded regions are rendered again when
+ * the transaction is committed; the others are reused as they are.
+ */
+static void memory_region_update_pending_for(MemoryRegion *mr)
+{
+    memory_region_update_pending = true;
+    if (memory_region_update_all) {
+        return;
+    }
+    if (!memory_region_update_set) {
+        memory_region_update_set = g_hash_table_new(g_direct_hash,
+                                                    g_direct_equal);
+    }
+    g_hash_table_add(memory_region_update_set, mr);
+}
+
+/* Request that every FlatView is rendered again, e.g. because a global
+ * property such as the migration dirty log changed.
+ */
+static void memory_region_update_pending_all(void)
+{
+    memory_region_update_pending = true;
+    memory_region_update_all = true;
+}
+
 typedef struct AddrRange AddrRange;
 
 /*
@@ -988,26 +1016,76 @@ static void flatviews_init(void)
     }
 }
 
+/* Return true if @mr, or anything rendered through it, was recorded by
+ * memory_region_update_pending_for() in the current transaction.  Disabled
+ * regions are visited as well, since enabling them changes the rendering.
+ *
+ * Regions found unchanged are added to @clean, so that a region reached
+ * from several roots or through several aliases (e.g. the RAM behind the
+ * PAM aliases) is walked only once per commit.
+ */
+static bool memory_region_tree_updated(MemoryRegion *mr, GHashTable *clean)
+{
+    MemoryRegion *subregion;
+
+    if (g_hash_table_contains(clean, mr)) {
+        return false;
+    }
+    if (g_hash_table_contains(memory_region_update_set, mr)) {
+        return true;
+    }
+    if (mr->alias && memory_region_tree_updated(mr->alias, clean)) {
+        return true;
+    }
+    QTAILQ_FOREACH(subregion, &mr->subregions, subregions_link) {
+        if (memory_region_tree_updated(subregion, clean)) {
+            return true;
+        }
+    }
+    g_hash_table_add(clean, mr);
+    return false;
+}
+
 static void flatviews_reset(void)
 {
     AddressSpace *as;
+    GHashTable *old_flat_views = flat_views;
+    GHashTable *clean = NULL;
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    flat_views = NULL;
     flatviews_init();
 
-    /* Render unique FVs */
+    if (old_flat_views && !memory_region_update_all) {
+        clean = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+
+    /* Render unique FVs, reusing those whose tree did not change */
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
+        FlatView *old_view;
 
         if (g_hash_table_lookup(flat_views, physmr)) {
             continue;
         }
 
+        old_view = clean && physmr ?
+            g_hash_table_lookup(old_flat_views, physmr) : NULL;
+        if (old_view && !memory_region_tree_updated(physmr, clean)) {
+            trace_flatview_reuse(old_view, physmr);
+            flatview_ref(old_view);
+            g_hash_table_replace(flat_views, physmr, old_view);
+            continue;
+        }
+
         generate_memory_topology(physmr);
     }
+
+    if (clean) {
+        g_hash_table_destroy(clean);
+    }
+    if (old_flat_views) {
+        g_hash_table_unref(old_flat_views);
+    }
 }
 
 static void address_space_set_flatview(AddressSpace *as)
@@ -1091,6 +1169,10 @@ void memory_region_transaction_commit(void)
                 address_space_update_ioeventfds(as);
             }
             memory_region_update_pending = false;
+            memory_region_update_all = false;
+            if (memory_region_update_set) {
+                g_hash_table_remove_all(memory_region_update_set);
+            }
             MEMORY_LISTENER_CALL_GLOBAL(commit, Forward);
         } else if (ioeventfd_update_pending) {
             QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
@@ -1934,7 +2016,9 @@ void memory_region_set_log(MemoryRegion *mr, bool log, unsigned client)
 
     memory_region_transaction_begin();
     mr->dirty_log_mask = (mr->dirty_log_mask & ~mask) | (log * mask);
-    memory_region_update_pending |= mr->enabled;
+    if (mr->enabled) {
+        memory_region_update_pending_for(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2014,7 +2098,9 @@ void memory_region_set_readonly(MemoryRegion *mr, bool readonly)
     if (mr->readonly != readonly) {
         memory_region_transaction_begin();
         mr->readonly = readonly;
-        memory_region_update_pending |= mr->enabled;
+        if (mr->enabled) {
+            memory_region_update_pending_for(mr);
+        }
         memory_region_transaction_commit();
     }
 }
@@ -2024,7 +2110,9 @@ void memory_region_rom_device_set_romd(MemoryRegion *mr, bool romd_mode)
     if (mr->romd_mode != romd_mode) {
         memory_region_transaction_begin();
         mr->romd_mode = romd_mode;
-        memory_region_update_pending |= mr->enabled;
+        if (mr->enabled) {
+            memory_region_update_pending_for(mr);
+        }
         memory_region_transaction_commit();
     }
 }
@@ -2294,7 +2382,9 @@ static void memory_region_update_container_subregions(MemoryRegion *subregion)
     }
     QTAILQ_INSERT_TAIL(&mr->subregions, subregion, subregions_link);
 done:
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
+    if (mr->enabled && subregion->enabled) {
+        memory_region_update_pending_for(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2332,8 +2422,10 @@ void memory_region_del_subregion(MemoryRegion *mr,
     assert(subregion->container == mr);
     subregion->container = NULL;
     QTAILQ_REMOVE(&mr->subregions, subregion, subregions_link);
+    if (mr->enabled && subregion->enabled) {
+        memory_region_update_pending_for(mr);
+    }
     memory_region_unref(subregion);
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
     memory_region_transaction_commit();
 }
 
@@ -2344,7 +2436,7 @@ void memory_region_set_enabled(MemoryRegion *mr, bool enabled)
     }
     memory_region_transaction_begin();
     mr->enabled = enabled;
-    memory_region_update_pending = true;
+    memory_region_update_pending_for(mr);
     memory_region_transaction_commit();
 }
 
@@ -2360,7 +2452,7 @@ void memory_region_set_size(MemoryRegion *mr, uint64_t size)
     }
     memory_region_transaction_begin();
     mr->size = s;
-    memory_region_update_pending = true;
+    memory_region_update_pending_for(mr);
     memory_region_transaction_commit();
 }
 
@@ -2397,7 +2489,9 @@ void memory_region_set_alias_offset(MemoryRegion *mr, hwaddr offset)
 
     memory_region_transaction_begin();
     mr->alias_offset = offset;
-    memory_region_update_pending |= mr->enabled;
+    if (mr->enabled) {
+        memory_region_update_pending_for(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2539,7 +2633,7 @@ void memory_global_dirty_log_start(void)
 
     /* Refresh DIRTY_LOG_MIGRATION bit.  */
     memory_region_transaction_begin();
-    memory_region_update_pending = true;
+    memory_region_update_pending_all();
     memory_region_transaction_commit();
 }
 
@@ -2549,7 +2643,7 @@ static void memory_global_dirty_log_do_stop(void)
 
     /* Refresh DIRTY_LOG_MIGRATION bit.  */
     memory_region_transaction_begin();
-    memory_region_update_pending = true;
+    memory_region_update_pending_all();
     memory_region_transaction_commit();
 
     MEMORY_LISTENER_CALL_GLOBAL(log_global_stop, Reverse);
@@ -2777,6 +2871,10 @@ void address_space_init(AddressSpace *as, MemoryRegion *root, const char *name)
     as->ioeventfds = NULL;
     QTAILQ_INIT(&as->listeners);
     QTAILQ_INSERT_TAIL(&address_spaces, as, address_spaces_link);
+    as->max_bounce_buffer_size = DEFAULT_MAX_BOUNCE_BUFFER_SIZE;
+    as->bounce_buffer_size = 0;
+    qemu_mutex_init(&as->map_client_list_lock);
+    QLIST_INIT(&as->map_client_list);
     as->name = g_strdup(name ? name : "anonymous");
     address_space_update_topology(as);
     address_space_update_ioeventfds(as);
@@ -2784,6 +2882,10 @@ void address_space_init(AddressSpace *as, MemoryRegion *root, const char *name)
 
 static void do_address_space_destroy(AddressSpace *as)
 {
+    assert(atomic_read(&as->bounce_buffer_size) == 0);
+    assert(QLIST_EMPTY(&as->map_client_list));
+    qemu_mutex_destroy(&as->map_client_list_lock);
+
     assert(QTAILQ_EMPTY(&as->listeners));
 
     flatview_unref(as->current_map);
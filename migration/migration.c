@@ -555,6 +555,7 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         qemu_target_page_size();
     info->ram->mbps = s->mbps;
     info->ram->dirty_sync_count = ram_counters.dirty_sync_count;
+    info->ram->dirty_sync_time = ram_counters.dirty_sync_time;
     info->ram->postcopy_requests = ram_counters.postcopy_requests;
     info->ram->page_size = qemu_target_page_size();
 
@@ -827,10 +827,11 @@ uint64_t ram_pagesize_summary(void)
 static void migration_bitmap_sync(RAMState *rs)
 {
     RAMBlock *block;
-    int64_t end_time;
+    int64_t start_time_us, end_time;
     uint64_t bytes_xfer_now;
 
     ram_counters.dirty_sync_count++;
+    start_time_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
 
     if (!rs->time_last_bitmap_sync) {
         rs->time_last_bitmap_sync = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
@@ -847,6 +848,8 @@ static void migration_bitmap_sync(RAMState *rs)
     rcu_read_unlock();
     qemu_mutex_unlock(&rs->bitmap_mutex);
 
+    ram_counters.dirty_sync_time = qemu_clock_get_us(QEMU_CLOCK_REALTIME) -
+                                   start_time_us;
     trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
 
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
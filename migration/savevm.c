@@ -186,7 +186,7 @@ static ssize_t block_writev_buffer(void *opaque, struct iovec *iov, int iovcnt,
     QEMUIOVector qiov;
 
     qemu_iovec_init_external(&qiov, iov, iovcnt);
-    ret = bdrv_writev_vmstate(opaque, &qiov, pos);
+    ret = bdrv_vmstate_io_writev(opaque, &qiov, pos);
     if (ret < 0) {
         return ret;
     }
@@ -197,12 +197,12 @@ static ssize_t block_writev_buffer(void *opaque, struct iovec *iov, int iovcnt,
 static ssize_t block_get_buffer(void *opaque, uint8_t *buf, int64_t pos,
                                 size_t size)
 {
-    return bdrv_load_vmstate(opaque, buf, pos, size);
+    return bdrv_vmstate_io_read(opaque, buf, pos, size);
 }
 
 static int bdrv_fclose(void *opaque)
 {
-    return bdrv_flush(opaque);
+    return bdrv_vmstate_io_close(opaque);
 }
 
 static const QEMUFileOps bdrv_read_ops = {
@@ -218,9 +218,9 @@ static const QEMUFileOps bdrv_write_ops = {
 static QEMUFile *qemu_fopen_bdrv(BlockDriverState *bs, int is_writable)
 {
     if (is_writable) {
-        return qemu_fopen_ops(bs, &bdrv_write_ops);
+        return qemu_fopen_ops(bdrv_vmstate_io_new(bs, false), &bdrv_write_ops);
     }
-    return qemu_fopen_ops(bs, &bdrv_read_ops);
+    return qemu_fopen_ops(bdrv_vmstate_io_new(bs, true), &bdrv_read_ops);
 }
 
 
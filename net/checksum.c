@@ -20,24 +20,207 @@
 #include "net/checksum.h"
 #include "net/eth.h"
 
-uint32_t net_checksum_add_cont(int len, uint8_t *buf, int seq)
+/*
+ * The ones' complement sum is byte order independent (RFC 1071), so the
+ * data is summed as host-endian words and the byte order fixed at the end.
+ * All helpers below return the host-endian sum folded to 16 bits.
+ */
+static inline uint32_t net_checksum_fold(uint64_t sum)
+{
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (sum & 0xffff) + (sum >> 16);
+}
+
+static uint32_t net_checksum_int(const uint8_t *buf, int len)
 {
-    uint32_t sum1 = 0, sum2 = 0;
-    int i;
+    uint64_t sum = 0;
+    int i = 0;
 
-    for (i = 0; i < len - 1; i += 2) {
-        sum1 += (uint32_t)buf[i];
-        sum2 += (uint32_t)buf[i + 1];
+    /* 32-bit words into a 64-bit accumulator cannot overflow for any int
+     * length, and 2^16 == 1 modulo 0xffff, so no carries are lost.
+     */
+    for (; i + 16 <= len; i += 16) {
+        sum += ldl_he_p(buf + i);
+        sum += ldl_he_p(buf + i + 4);
+        sum += ldl_he_p(buf + i + 8);
+        sum += ldl_he_p(buf + i + 12);
+    }
+    for (; i + 4 <= len; i += 4) {
+        sum += ldl_he_p(buf + i);
+    }
+    if (i + 2 <= len) {
+        sum += lduw_he_p(buf + i);
+        i += 2;
     }
     if (i < len) {
-        sum1 += (uint32_t)buf[i];
+        uint8_t tail[2] = { buf[i], 0 };
+        sum += lduw_he_p(tail);
+    }
+    return net_checksum_fold(sum);
+}
+
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+/* Called only for len >= 64.  */
+static uint32_t net_checksum_avx2(const uint8_t *buf, int len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc64 = zero;
+    uint64_t lanes[4], sum;
+    int i = 0;
+
+    while (i + 32 <= len) {
+        /* Each 32-bit lane grows by at most 2 * 0xffff per iteration,
+         * so widen into the 64-bit lanes every 16K iterations.
+         */
+        int end = MIN(len & -32, i + 32 * 16384);
+        __m256i acc32 = zero;
+
+        do {
+            __m256i t = _mm256_loadu_si256((const __m256i *)(buf + i));
+            acc32 = _mm256_add_epi32(acc32, _mm256_unpacklo_epi16(t, zero));
+            acc32 = _mm256_add_epi32(acc32, _mm256_unpackhi_epi16(t, zero));
+            i += 32;
+        } while (i < end);
+
+        acc64 = _mm256_add_epi64(acc64, _mm256_unpacklo_epi32(acc32, zero));
+        acc64 = _mm256_add_epi64(acc64, _mm256_unpackhi_epi32(acc32, zero));
+    }
+
+    _mm256_storeu_si256((__m256i *)lanes, acc64);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    /* i is a multiple of 32, so the tail keeps the word alignment.  */
+    sum += net_checksum_int(buf + i, len - i);
+    return net_checksum_fold(sum);
+}
+#pragma GCC pop_options
+
+/* Note that for test_net_checksum_next_accel, the most preferred
+ * ISA must have the least significant bit.
+ */
+#define CACHE_AVX2    1
+
+static unsigned cpuid_cache;
+static uint32_t (*net_checksum_accel)(const uint8_t *, int) = net_checksum_int;
+
+static void init_accel(unsigned cache)
+{
+    uint32_t (*fn)(const uint8_t *, int) = net_checksum_int;
+
+    if (cache & CACHE_AVX2) {
+        fn = net_checksum_avx2;
+    }
+    net_checksum_accel = fn;
+}
+
+#include "qemu/cpuid.h"
+
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 1) {
+        __cpuid(1, a, b, c, d);
+
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX) && max >= 7) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((bv & 6) == 6 && (b & bit_AVX2)) {
+                cache |= CACHE_AVX2;
+            }
+        }
     }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+
+bool test_net_checksum_next_accel(void)
+{
+    /* If no bits set, we just tested net_checksum_int, and there
+       are no more acceleration options to test.  */
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+
+static uint32_t select_accel_fn(const uint8_t *buf, int len)
+{
+    if (likely(len >= 64)) {
+        return net_checksum_accel(buf, len);
+    }
+    return net_checksum_int(buf, len);
+}
+
+#else
+#define select_accel_fn  net_checksum_int
+bool test_net_checksum_next_accel(void)
+{
+    return false;
+}
+#endif /* CONFIG_AVX2_OPT */
+
+/* Convert a folded host-endian sum to the caller's view of the data,
+ * which starts at an odd offset of the packet if @seq is odd.
+ */
+static inline uint32_t net_checksum_to_seq(uint32_t sum, int seq)
+{
+    sum = be16_to_cpu(sum);
+    return seq & 1 ? bswap16(sum) : sum;
+}
+
+uint32_t net_checksum_add_cont(int len, uint8_t *buf, int seq)
+{
+    if (len <= 0) {
+        return 0;
+    }
+    return net_checksum_to_seq(select_accel_fn(buf, len), seq);
+}
+
+uint32_t net_checksum_add_copy_cont(int len, uint8_t *dst, const uint8_t *src,
+                                    int seq)
+{
+    uint64_t sum = 0;
+    int i = 0;
+
+    if (len <= 0) {
+        return 0;
+    }
+    for (; i + 8 <= len; i += 8) {
+        uint32_t w0 = ldl_he_p(src + i);
+        uint32_t w1 = ldl_he_p(src + i + 4);
+
+        stl_he_p(dst + i, w0);
+        stl_he_p(dst + i + 4, w1);
+        sum += w0;
+        sum += w1;
+    }
+    for (; i + 2 <= len; i += 2) {
+        uint16_t w = lduw_he_p(src + i);
+
+        stw_he_p(dst + i, w);
+        sum += w;
+    }
+    if (i < len) {
+        uint8_t tail[2] = { src[i], 0 };
 
-    if (seq & 1) {
-        return sum1 + (sum2 << 8);
-    } else {
-        return sum2 + (sum1 << 8);
+        dst[i] = src[i];
+        sum += lduw_he_p(tail);
     }
+    return net_checksum_to_seq(net_checksum_fold(sum), seq);
 }
 
 uint16_t net_checksum_finish(uint32_t sum)
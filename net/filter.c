@@ -217,6 +217,13 @@ static void netfilter_complete(UserCreatable *uc, Error **errp)
         return;
     }
 
+    /* Filters run in the main loop, not in the peer's IOThread */
+    if (ncs[0]->peer && ncs[0]->peer->iothread) {
+        error_setg(errp, "netdev '%s' is used by a NIC with an iothread",
+                   nf->netdev_id);
+        return;
+    }
+
     nf->netdev = ncs[0];
 
     if (nfc->setup) {
@@ -508,6 +508,19 @@ void qemu_set_vnet_hdr_len(NetClientState *nc, int len)
     nc->info->set_vnet_hdr_len(nc, len);
 }
 
+/* Move the event handlers of @nc to @ctx, or back to the main loop if @ctx
+ * is NULL.  Returns false if the backend always runs in the main loop.
+ */
+bool qemu_net_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    if (!nc || !nc->info->set_aio_context) {
+        return false;
+    }
+
+    nc->info->set_aio_context(nc, ctx);
+    return true;
+}
+
 int qemu_set_vnet_le(NetClientState *nc, bool is_le)
 {
 #ifdef HOST_WORDS_BIGENDIAN
@@ -681,6 +694,19 @@ ssize_t qemu_send_packet_async(NetClientState *sender,
                                              buf, size, sent_cb);
 }
 
+/* Tell the peer of @nc that a run of packets is about to be sent (@begin
+ * true) or has been sent (@begin false), so that it can defer per-packet
+ * work such as guest notifications to the end of the run.
+ */
+void qemu_net_burst(NetClientState *nc, bool begin)
+{
+    NetClientState *peer = nc->peer;
+
+    if (peer && peer->info->burst) {
+        peer->info->burst(peer, begin);
+    }
+}
+
 void qemu_send_packet(NetClientState *nc, const uint8_t *buf, int size)
 {
     qemu_send_packet_async(nc, buf, size, NULL);
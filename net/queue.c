@@ -40,6 +40,13 @@
  * unbounded queueing.
  */
 
+/* Packets up to NET_PACKET_POOL_BUFSIZE bytes are allocated with that
+ * capacity and recycled through a small per-queue free list, so that a
+ * queue under back-pressure does not go to malloc for every packet.
+ */
+#define NET_PACKET_POOL_BUFSIZE 2048
+#define NET_PACKET_POOL_MAX     128
+
 struct NetPacket {
     QTAILQ_ENTRY(NetPacket) entry;
     NetClientState *sender;
@@ -56,6 +63,8 @@ struct NetQueue {
     NetQueueDeliverFunc *deliver;
 
     QTAILQ_HEAD(packets, NetPacket) packets;
+    QTAILQ_HEAD(, NetPacket) pool;
+    uint32_t pool_count;
 
     unsigned delivering : 1;
 };
@@ -72,6 +81,7 @@ NetQueue *qemu_new_net_queue(NetQueueDeliverFunc *deliver, void *opaque)
     queue->deliver = deliver;
 
     QTAILQ_INIT(&queue->packets);
+    QTAILQ_INIT(&queue->pool);
 
     queue->delivering = 0;
 
@@ -86,10 +96,43 @@ void qemu_del_net_queue(NetQueue *queue)
         QTAILQ_REMOVE(&queue->packets, packet, entry);
         g_free(packet);
     }
+    QTAILQ_FOREACH_SAFE(packet, &queue->pool, entry, next) {
+        QTAILQ_REMOVE(&queue->pool, packet, entry);
+        g_free(packet);
+    }
 
     g_free(queue);
 }
 
+static NetPacket *qemu_net_packet_alloc(NetQueue *queue, size_t size)
+{
+    NetPacket *packet;
+
+    if (size > NET_PACKET_POOL_BUFSIZE) {
+        return g_malloc(sizeof(NetPacket) + size);
+    }
+
+    packet = QTAILQ_FIRST(&queue->pool);
+    if (packet) {
+        QTAILQ_REMOVE(&queue->pool, packet, entry);
+        queue->pool_count--;
+        return packet;
+    }
+    return g_malloc(sizeof(NetPacket) + NET_PACKET_POOL_BUFSIZE);
+}
+
+static void qemu_net_packet_free(NetQueue *queue, NetPacket *packet)
+{
+    if (packet->size > NET_PACKET_POOL_BUFSIZE ||
+        queue->pool_count >= NET_PACKET_POOL_MAX) {
+        g_free(packet);
+        return;
+    }
+
+    QTAILQ_INSERT_HEAD(&queue->pool, packet, entry);
+    queue->pool_count++;
+}
+
 static void qemu_net_queue_append(NetQueue *queue,
                                   NetClientState *sender,
                                   unsigned flags,
@@ -102,7 +145,7 @@ static void qemu_net_queue_append(NetQueue *queue,
     if (queue->nq_count >= queue->nq_maxlen && !sent_cb) {
         return; /* drop if queue full and no callback */
     }
-    packet = g_malloc(sizeof(NetPacket) + size);
+    packet = qemu_net_packet_alloc(queue, size);
     packet->sender = sender;
     packet->flags = flags;
     packet->size = size;
@@ -131,7 +174,7 @@ void qemu_net_queue_append_iov(NetQueue *queue,
         max_len += iov[i].iov_len;
     }
 
-    packet = g_malloc(sizeof(NetPacket) + max_len);
+    packet = qemu_net_packet_alloc(queue, max_len);
     packet->sender = sender;
     packet->sent_cb = sent_cb;
     packet->flags = flags;
@@ -243,7 +286,7 @@ void qemu_net_queue_purge(NetQueue *queue, NetClientState *from)
             if (packet->sent_cb) {
                 packet->sent_cb(packet->sender, 0);
             }
-            g_free(packet);
+            qemu_net_packet_free(queue, packet);
         }
     }
 }
@@ -273,7 +316,7 @@ bool qemu_net_queue_flush(NetQueue *queue)
             packet->sent_cb(packet->sender, ret);
         }
 
-        g_free(packet);
+        qemu_net_packet_free(queue, packet);
     }
     return true;
 }
@@ -44,6 +44,7 @@
 #include "net/tap.h"
 
 #include "net/vhost_net.h"
+#include "trace.h"
 
 typedef struct TAPState {
     NetClientState nc;
@@ -59,6 +60,7 @@ typedef struct TAPState {
     VHostNetState *vhost_net;
     unsigned host_vnet_hdr_len;
     Notifier exit;
+    AioContext *ctx;    /* NULL when the fd is polled by the main loop */
 } TAPState;
 
 static void launch_script(const char *setup_script, const char *ifname,
@@ -69,10 +71,27 @@ static void tap_writable(void *opaque);
 
 static void tap_update_fd_handler(TAPState *s)
 {
-    qemu_set_fd_handler(s->fd,
-                        s->read_poll && s->enabled ? tap_send : NULL,
-                        s->write_poll && s->enabled ? tap_writable : NULL,
-                        s);
+    IOHandler *fd_read = s->read_poll && s->enabled ? tap_send : NULL;
+    IOHandler *fd_write = s->write_poll && s->enabled ? tap_writable : NULL;
+
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->fd, true, fd_read, fd_write, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->fd, fd_read, fd_write, s);
+    }
+}
+
+static void tap_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    TAPState *s = DO_UPCAST(TAPState, nc, nc);
+
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->fd, true, NULL, NULL, NULL, NULL);
+    } else {
+        qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
+    }
+    s->ctx = ctx;
+    tap_update_fd_handler(s);
 }
 
 static void tap_read_poll(TAPState *s, bool enable)
@@ -87,13 +106,33 @@ static void tap_write_poll(TAPState *s, bool enable)
     tap_update_fd_handler(s);
 }
 
+/* The fd handlers run without the AioContext lock when the tap has been
+ * moved to an IOThread, so take it around anything that reaches the peer.
+ */
+static void tap_acquire(AioContext *ctx)
+{
+    if (ctx) {
+        aio_context_acquire(ctx);
+    }
+}
+
+static void tap_release(AioContext *ctx)
+{
+    if (ctx) {
+        aio_context_release(ctx);
+    }
+}
+
 static void tap_writable(void *opaque)
 {
     TAPState *s = opaque;
+    AioContext *ctx = s->ctx;
 
+    tap_acquire(ctx);
     tap_write_poll(s, false);
 
     qemu_flush_queued_packets(&s->nc);
+    tap_release(ctx);
 }
 
 static ssize_t tap_write_packet(TAPState *s, const struct iovec *iov, int iovcnt)
@@ -182,9 +221,14 @@ static void tap_send_completed(NetClientState *nc, ssize_t len)
 static void tap_send(void *opaque)
 {
     TAPState *s = opaque;
+    AioContext *ctx = s->ctx;
     int size;
     int packets = 0;
 
+    tap_acquire(ctx);
+
+    /* Let the peer complete the whole run at once */
+    qemu_net_burst(&s->nc, true);
     while (true) {
         uint8_t *buf = s->buf;
 
@@ -217,6 +261,9 @@ static void tap_send(void *opaque)
             break;
         }
     }
+    qemu_net_burst(&s->nc, false);
+    trace_tap_send_burst(s, packets);
+    tap_release(ctx);
 }
 
 static bool tap_has_ufo(NetClientState *nc)
@@ -359,6 +406,7 @@ static NetClientInfo net_tap_info = {
     .set_vnet_hdr_len = tap_set_vnet_hdr_len,
     .set_vnet_le = tap_set_vnet_le,
     .set_vnet_be = tap_set_vnet_be,
+    .set_aio_context = tap_set_aio_context,
 };
 
 static TAPState *net_tap_fd_init(NetClientState *peer,
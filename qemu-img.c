@@ -1072,11 +1072,17 @@ done:
  */
 static int64_t find_nonzero(const uint8_t *buf, int64_t n)
 {
-    int64_t i;
+    int64_t i = 0;
     int64_t end = QEMU_ALIGN_DOWN(n, BDRV_SECTOR_SIZE);
+    bool is_zero;
 
-    for (i = 0; i < end; i += BDRV_SECTOR_SIZE) {
-        if (!buffer_is_zero(buf + i, BDRV_SECTOR_SIZE)) {
+    if (end) {
+        i = buffer_is_zero_run(buf, BDRV_SECTOR_SIZE, end / BDRV_SECTOR_SIZE,
+                               &is_zero) * BDRV_SECTOR_SIZE;
+        if (!is_zero) {
+            return 0;
+        }
+        if (i < end) {
             return i;
         }
     }
@@ -1096,20 +1102,12 @@ static int64_t find_nonzero(const uint8_t *buf, int64_t n)
 static int is_allocated_sectors(const uint8_t *buf, int n, int *pnum)
 {
     bool is_zero;
-    int i;
 
     if (n <= 0) {
         *pnum = 0;
         return 0;
     }
-    is_zero = buffer_is_zero(buf, 512);
-    for(i = 1; i < n; i++) {
-        buf += 512;
-        if (is_zero != buffer_is_zero(buf, 512)) {
-            break;
-        }
-    }
-    *pnum = i;
+    *pnum = buffer_is_zero_run(buf, 512, n, &is_zero);
     return !is_zero;
 }
 
@@ -0,0 +1,131 @@
+/*
+ * Micro-benchmark for PCI BAR remapping, i.e. memory topology updates
+ *
+ * Boots a PC machine under qtest with a number of PCI devices, each with
+ * its own bus master address space, and moves the memory BAR of one of
+ * them back and forth.  Every move commits a memory transaction, so the
+ * result is dominated by how many FlatViews have to be rendered again.
+ *
+ * Run it with QTEST_QEMU_BINARY pointing at an x86 system emulator, e.g.
+ *   QTEST_QEMU_BINARY=x86_64-softmmu/qemu-system-x86_64 \
+ *       tests/bar-remap-bench -n 64
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "libqos/pci.h"
+#include "libqos/pci-pc.h"
+#include "hw/pci/pci_regs.h"
+
+/* Inside the PCI hole that libqos sets up for the PC machine */
+#define BAR_ADDR_A 0xe0000000
+#define BAR_ADDR_B 0xe0001000
+
+static unsigned int n_devices = 16;
+static unsigned int duration = 1;
+
+static const char commands_string[] =
+    " -d = duration in seconds\n"
+    " -n = number of PCI devices besides the remapped one";
+
+static void usage_complete(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+}
+
+static QPCIBus *start_machine(void)
+{
+    GString *cmdline = g_string_new("-machine pc -vga none "
+                                    "-device pci-testdev,addr=04.0");
+    unsigned int i;
+
+    for (i = 0; i < n_devices; i++) {
+        g_string_append(cmdline, " -device pci-testdev");
+    }
+    qtest_start(cmdline->str);
+    g_string_free(cmdline, true);
+    return qpci_init_pc(NULL);
+}
+
+static uint64_t run_test(QPCIDevice *dev)
+{
+    int64_t end = g_get_monotonic_time() + duration * G_USEC_PER_SEC;
+    uint64_t ops = 0;
+
+    do {
+        unsigned int i;
+
+        for (i = 0; i < 64; i++) {
+            qpci_config_writel(dev, PCI_BASE_ADDRESS_0,
+                               ops++ & 1 ? BAR_ADDR_B : BAR_ADDR_A);
+        }
+    } while (g_get_monotonic_time() < end);
+
+    return ops;
+}
+
+static void pr_params(void)
+{
+    printf("Parameters:\n");
+    printf(" duration:          %u s\n", duration);
+    printf(" # of devices:      %u\n", n_devices + 1);
+}
+
+static void pr_stats(uint64_t n_ops)
+{
+    printf("Results:\n");
+    printf(" Remaps:            %" PRIu64 "\n", n_ops);
+    printf(" Throughput:        %.2f remaps/s\n", (double)n_ops / duration);
+    printf(" Time per remap:    %.2f us\n", duration * 1e6 / n_ops);
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "hd:n:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'h':
+            usage_complete(argv);
+            exit(0);
+        case 'd':
+            duration = MAX(atoi(optarg), 1);
+            break;
+        case 'n':
+            n_devices = atoi(optarg);
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QPCIBus *bus;
+    QPCIDevice *dev;
+    uint64_t n_ops;
+
+    parse_args(argc, argv);
+    pr_params();
+
+    bus = start_machine();
+    dev = qpci_device_find(bus, QPCI_DEVFN(4, 0));
+    g_assert(dev != NULL);
+    qpci_config_writel(dev, PCI_BASE_ADDRESS_0, BAR_ADDR_A);
+    qpci_device_enable(dev);
+
+    n_ops = run_test(dev);
+
+    g_free(dev);
+    qpci_free_pc(bus);
+    qtest_end();
+
+    pr_stats(n_ops);
+    return 0;
+}
@@ -278,6 +278,94 @@ static void test_i440fx_pam(gconstpointer opaque)
     qtest_end();
 }
 
+#define I440FX_SMRAM 0x72
+#define SMRAM_D_OPEN 0x40
+
+static void vga_seq_write(uint8_t index, uint8_t mask, uint8_t value)
+{
+    outb(0x3c4, index);
+    outb(0x3c5, (inb(0x3c5) & ~mask) | value);
+}
+
+static void vga_gfx_write(uint8_t index, uint8_t mask, uint8_t value)
+{
+    outb(0x3ce, index);
+    outb(0x3cf, (inb(0x3cf) & ~mask) | value);
+}
+
+/* Memory transactions only render again the FlatViews whose tree reaches a
+ * changed region.  Check that changes are still seen when they are only
+ * reached through an alias, or through a subregion that is disabled at the
+ * time of the change.
+ */
+static void test_i440fx_flatview_reuse(gconstpointer opaque)
+{
+    QPCIBus *bus;
+    QPCIDevice *host, *vga;
+    QPCIBar bar;
+    uint16_t cmd;
+    uint8_t smram;
+
+    qtest_start("-vga std");
+    bus = qpci_init_pc(NULL);
+    host = qpci_device_find(bus, QPCI_DEVFN(0, 0));
+    g_assert(host != NULL);
+    vga = qpci_device_find(bus, QPCI_DEVFN(2, 0));
+    g_assert(vga != NULL);
+    g_assert_cmphex(qpci_config_readw(vga, PCI_VENDOR_ID), ==, 0x1234);
+
+    /* The BAR is in the PCI address space, which system memory reaches
+     * only through the pci-hole alias.
+     */
+    qpci_device_enable(vga);
+    bar = qpci_iomap(vga, 0, NULL);
+    qpci_io_writeb(vga, bar, 0, 0x5a);
+    g_assert_cmphex(qpci_io_readb(vga, bar, 0), ==, 0x5a);
+
+    cmd = qpci_config_readw(vga, PCI_COMMAND);
+    qpci_config_writew(vga, PCI_COMMAND, cmd & ~PCI_COMMAND_MEMORY);
+    g_assert_cmphex(qpci_io_readb(vga, bar, 0), !=, 0x5a);
+    qpci_config_writew(vga, PCI_COMMAND, cmd);
+    g_assert_cmphex(qpci_io_readb(vga, bar, 0), ==, 0x5a);
+
+    /* Opening SMRAM disables the smram-region alias, which is the only
+     * path from system memory to the legacy VGA window, and shows the RAM
+     * below it.
+     */
+    smram = qpci_config_readb(host, I440FX_SMRAM);
+    qpci_config_writeb(host, I440FX_SMRAM, smram | SMRAM_D_OPEN);
+    write_area(0xa0000, 0xa0fff, 0x42);
+    write_area(0xb8000, 0xb8fff, 0x24);
+
+    /* Map VRAM at 0xb8000 in chain-4 mode behind the disabled alias */
+    vga_seq_write(0x02, 0x0f, 0x0f);
+    vga_seq_write(0x04, 0x08, 0x08);
+    vga_gfx_write(0x06, 0x0c, 3 << 2);
+    g_assert(verify_area(0xa0000, 0xa0fff, 0x42));
+    g_assert(verify_area(0xb8000, 0xb8fff, 0x24));
+
+    /* Closing SMRAM shows the new mapping */
+    qpci_config_writeb(host, I440FX_SMRAM, smram & ~SMRAM_D_OPEN);
+    g_assert_cmphex(readb(0xb8000), ==, 0x5a);
+    g_assert(!verify_area(0xa0000, 0xa0fff, 0x42));
+
+    /* Move VRAM to 0xa0000 while the alias is enabled */
+    vga_gfx_write(0x06, 0x0c, 1 << 2);
+    g_assert_cmphex(readb(0xa0000), ==, 0x5a);
+    g_assert(!verify_area(0xb8000, 0xb8fff, 0x24));
+
+    qpci_config_writeb(host, I440FX_SMRAM, smram | SMRAM_D_OPEN);
+    g_assert(verify_area(0xa0000, 0xa0fff, 0x42));
+    g_assert(verify_area(0xb8000, 0xb8fff, 0x24));
+    qpci_config_writeb(host, I440FX_SMRAM, smram);
+
+    qpci_iounmap(vga, bar);
+    g_free(vga);
+    g_free(host);
+    qpci_free_pc(bus);
+    qtest_end();
+}
+
 #define BLOB_SIZE ((size_t)65536)
 #define ISA_BIOS_MAXSZ ((size_t)(128 * 1024))
 
@@ -406,6 +494,8 @@ int main(int argc, char **argv)
 
     qtest_add_data_func("i440fx/defaults", &data, test_i440fx_defaults);
     qtest_add_data_func("i440fx/pam", &data, test_i440fx_pam);
+    qtest_add_data_func("i440fx/flatview-reuse", &data,
+                        test_i440fx_flatview_reuse);
     add_firmware_test("i440fx/firmware/bios", request_bios);
     add_firmware_test("i440fx/firmware/pflash", request_pflash);
 
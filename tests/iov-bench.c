@@ -0,0 +1,155 @@
+/*
+ * Micro-benchmark for the iovec helpers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/iov.h"
+#include "qemu/timer.h"
+
+static unsigned int duration = 1;
+static unsigned int iov_cnt = 1;
+static size_t elem_size = 1500;
+static size_t op_size;
+static size_t op_offset;
+
+static const char commands_string[] =
+    " -d = duration in seconds, per helper\n"
+    " -n = number of iovec elements\n"
+    " -s = size of each iovec element, in bytes\n"
+    " -b = bytes per operation (default: the whole iovec)\n"
+    " -o = offset into the iovec for each operation";
+
+static void usage_complete(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+}
+
+enum {
+    BENCH_TO_BUF,
+    BENCH_FROM_BUF,
+    BENCH_MEMSET,
+    BENCH_COPY,
+    BENCH_MAX,
+};
+
+static const char *const bench_names[BENCH_MAX] = {
+    [BENCH_TO_BUF] = "iov_to_buf",
+    [BENCH_FROM_BUF] = "iov_from_buf",
+    [BENCH_MEMSET] = "iov_memset",
+    [BENCH_COPY] = "iov_copy",
+};
+
+static void run_bench(int bench, struct iovec *iov, void *buf)
+{
+    struct iovec *dst_iov = g_new(struct iovec, iov_cnt);
+    int64_t end = get_clock() + duration * NANOSECONDS_PER_SECOND;
+    uint64_t ops = 0;
+    uint64_t bytes = 0;
+
+    do {
+        unsigned int i;
+
+        for (i = 0; i < 256; i++) {
+            switch (bench) {
+            case BENCH_TO_BUF:
+                bytes += iov_to_buf(iov, iov_cnt, op_offset, buf, op_size);
+                break;
+            case BENCH_FROM_BUF:
+                bytes += iov_from_buf(iov, iov_cnt, op_offset, buf, op_size);
+                break;
+            case BENCH_MEMSET:
+                bytes += iov_memset(iov, iov_cnt, op_offset, i, op_size);
+                break;
+            case BENCH_COPY:
+                bytes += iov_copy(dst_iov, iov_cnt, iov, iov_cnt, op_offset,
+                                  op_size);
+                break;
+            }
+        }
+        ops += 256;
+    } while (get_clock() < end);
+
+    printf(" %-18s %8.2f Mops/s", bench_names[bench], ops / 1e6 / duration);
+    if (bench != BENCH_COPY) {
+        printf(" %8.2f GB/s", bytes / 1e9 / duration);
+    }
+    printf("\n");
+    g_free(dst_iov);
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "hb:d:n:o:s:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'h':
+            usage_complete(argv);
+            exit(0);
+        case 'b':
+            op_size = atol(optarg);
+            break;
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'n':
+            iov_cnt = MAX(atoi(optarg), 1);
+            break;
+        case 'o':
+            op_offset = atol(optarg);
+            break;
+        case 's':
+            elem_size = MAX(atol(optarg), 1);
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct iovec *iov;
+    size_t total;
+    void *buf;
+    unsigned int i;
+    int bench;
+
+    parse_args(argc, argv);
+    total = elem_size * iov_cnt;
+    if (op_offset >= total) {
+        op_offset = 0;
+    }
+    if (!op_size || op_size > total - op_offset) {
+        op_size = total - op_offset;
+    }
+
+    iov = g_new(struct iovec, iov_cnt);
+    for (i = 0; i < iov_cnt; i++) {
+        iov[i].iov_base = g_malloc0(elem_size);
+        iov[i].iov_len = elem_size;
+    }
+    buf = g_malloc0(total);
+
+    printf("Parameters:\n");
+    printf(" # of elements:     %u\n", iov_cnt);
+    printf(" element size:      %zu\n", elem_size);
+    printf(" bytes per op:      %zu\n", op_size);
+    printf(" offset:            %zu\n", op_offset);
+    printf("Results:\n");
+    for (bench = 0; bench < BENCH_MAX; bench++) {
+        run_bench(bench, iov, buf);
+    }
+
+    for (i = 0; i < iov_cnt; i++) {
+        g_free(iov[i].iov_base);
+    }
+    g_free(iov);
+    g_free(buf);
+    return 0;
+}
@@ -28,19 +28,33 @@ static void ptimer_test_expire_qemu_timers(int64_t expire_time,
                                            QEMUClockType type)
 {
     QEMUTimerList *timer_list = main_loop_tlg.tl[type];
-    QEMUTimer *t = timer_list->active_timers.next;
+    GList *expired = NULL;
+    GList *l;
+
+    /* the callbacks can modify the timer list, so collect the timers first */
+    for (l = timer_list->active_timers; l != NULL; l = l->next) {
+        QEMUTimer *t = l->data;
 
-    while (t != NULL) {
         if (t->expire_time == expire_time) {
-            timer_del(t);
+            expired = g_list_append(expired, t);
+        }
+    }
 
-            if (t->cb != NULL) {
-                t->cb(t->opaque);
-            }
+    for (l = expired; l != NULL; l = l->next) {
+        QEMUTimer *t = l->data;
+
+        /* skip timers that an earlier callback deleted or rearmed */
+        if (t->expire_time != expire_time ||
+            !g_list_find(timer_list->active_timers, t)) {
+            continue;
         }
+        timer_del(t);
 
-        t = t->next;
+        if (t->cb != NULL) {
+            t->cb(t->opaque);
+        }
     }
+    g_list_free(expired);
 }
 
 static void ptimer_test_set_qemu_time_ns(int64_t ns)
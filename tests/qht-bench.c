@@ -9,6 +9,7 @@
 #include "qemu/atomic.h"
 #include "qemu/qht.h"
 #include "qemu/rcu.h"
+#include "qemu/timer.h"
 #include "exec/tb-hash-xx.h"
 
 struct thread_stats {
@@ -22,9 +23,24 @@ struct thread_stats {
     size_t not_rz;
 };
 
+/*
+ * Latency histogram: values below 2^LAT_SUB_BITS ns get a bucket each; above
+ * that, each power of two is split into 2^LAT_SUB_BITS linear sub-buckets, so
+ * that the relative error of a reported percentile is at most 1/8.
+ */
+#define LAT_SUB_BITS 3
+#define LAT_N_BUCKETS (64 << LAT_SUB_BITS)
+
+struct lat_hist {
+    uint64_t buckets[LAT_N_BUCKETS];
+    uint64_t max;
+};
+
 struct thread_info {
     void (*func)(struct thread_info *);
     struct thread_stats stats;
+    struct lat_hist *lat_rd;
+    struct lat_hist *lat_up;
     uint64_t r;
     bool write_op; /* writes alternate between insertions and removals */
     bool resize_down;
@@ -63,6 +79,7 @@ static int qht_mode;
 
 static bool test_start;
 static bool test_stop;
+static bool measure_latency;
 
 static struct thread_info *rw_info;
 
@@ -84,7 +101,9 @@ static const char commands_string[] =
     " -R = enable auto-resize\n"
     " -S = resize rate (0.0 to 100.0)\n"
     " -D = delay (in us) between potential resizes\n"
-    " -N = number of resize threads";
+    " -N = number of resize threads\n"
+    "\n"
+    " -p = measure per-operation latency and report percentiles";
 
 static void usage_complete(int argc, char *argv[])
 {
@@ -139,12 +158,52 @@ static void do_rz(struct thread_info *info)
     g_usleep(resize_delay);
 }
 
+static inline unsigned int lat_to_bucket(uint64_t ns)
+{
+    unsigned int msb;
+
+    if (ns < (1 << LAT_SUB_BITS)) {
+        return ns;
+    }
+    msb = 63 - clz64(ns);
+    return ((msb - LAT_SUB_BITS + 1) << LAT_SUB_BITS) +
+           ((ns >> (msb - LAT_SUB_BITS)) & ((1 << LAT_SUB_BITS) - 1));
+}
+
+/* lower bound of the latencies that fall into @bucket */
+static uint64_t lat_from_bucket(unsigned int bucket)
+{
+    unsigned int shift;
+    uint64_t sub;
+
+    if (bucket < (1 << LAT_SUB_BITS)) {
+        return bucket;
+    }
+    shift = (bucket >> LAT_SUB_BITS) - 1;
+    sub = bucket & ((1 << LAT_SUB_BITS) - 1);
+    return ((1ULL << LAT_SUB_BITS) + sub) << shift;
+}
+
+static inline void lat_record(struct lat_hist *hist, int64_t start)
+{
+    uint64_t ns = get_clock() - start;
+
+    hist->buckets[lat_to_bucket(ns)]++;
+    if (ns > hist->max) {
+        hist->max = ns;
+    }
+}
+
 static void do_rw(struct thread_info *info)
 {
     struct thread_stats *stats = &info->stats;
+    int64_t start = 0;
     uint32_t hash;
     long *p;
 
+    if (measure_latency) {
+        start = get_clock();
+    }
     if (info->r >= update_threshold) {
         bool read;
 
@@ -156,6 +215,9 @@ static void do_rw(struct thread_info *info)
         } else {
             stats->not_rd++;
         }
+        if (measure_latency) {
+            lat_record(info->lat_rd, start);
+        }
     } else {
         p = &keys[info->r & (update_range - 1)];
         hash = h(*p);
@@ -183,6 +245,9 @@ static void do_rw(struct thread_info *info)
             }
         }
         info->write_op = !info->write_op;
+        if (measure_latency) {
+            lat_record(info->lat_up, start);
+        }
     }
 }
 
@@ -219,6 +284,8 @@ static void prepare_thread_info(struct thread_info *info, int i)
     info->resize_down = true;
 
     memset(&info->stats, 0, sizeof(info->stats));
+    info->lat_rd = measure_latency ? g_new0(struct lat_hist, 1) : NULL;
+    info->lat_up = measure_latency ? g_new0(struct lat_hist, 1) : NULL;
 }
 
 static void
@@ -264,6 +331,7 @@ static void pr_params(void)
         printf(" # resize threads   %u\n", n_rz_threads);
     }
     printf(" update rate:       %f%%\n", update_rate * 100.0);
+    printf(" latency:           %s\n", measure_latency ? "on" : "off");
     printf(" offset:            %ld\n", populate_offset);
     printf(" initial key range: %zu\n", init_range);
     printf(" lookup range:      %lu\n", lookup_range);
@@ -352,9 +420,61 @@ static void add_stats(struct thread_stats *s, struct thread_info *info, int n)
     }
 }
 
+static void add_lat(struct lat_hist *s, struct lat_hist *hist)
+{
+    int i;
+
+    for (i = 0; i < LAT_N_BUCKETS; i++) {
+        s->buckets[i] += hist->buckets[i];
+    }
+    s->max = MAX(s->max, hist->max);
+}
+
+static void pr_lat(const char *name, struct lat_hist *hist)
+{
+    static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    int i, j;
+
+    for (i = 0; i < LAT_N_BUCKETS; i++) {
+        total += hist->buckets[i];
+    }
+    if (total == 0) {
+        return;
+    }
+
+    printf(" %-19s", name);
+    for (i = 0, j = 0; i < LAT_N_BUCKETS && j < ARRAY_SIZE(percentiles); i++) {
+        sum += hist->buckets[i];
+        while (j < ARRAY_SIZE(percentiles) &&
+               sum >= total * percentiles[j] / 100.0) {
+            printf("p%g: %" PRIu64 " ", percentiles[j], lat_from_bucket(i));
+            j++;
+        }
+    }
+    printf("max: %" PRIu64 " (ns)\n", hist->max);
+}
+
+static void pr_lat_stats(void)
+{
+    struct lat_hist rd = {};
+    struct lat_hist up = {};
+    int i;
+
+    for (i = 0; i < n_rw_threads; i++) {
+        add_lat(&rd, rw_info[i].lat_rd);
+        add_lat(&up, rw_info[i].lat_up);
+    }
+    printf(" Latency:\n");
+    pr_lat("  lookups:", &rd);
+    pr_lat("  updates:", &up);
+}
+
 static void pr_stats(void)
 {
     struct thread_stats s = {};
+    struct qht_stats ht_stats;
     double tx;
 
     add_stats(&s, rw_info, n_rw_threads);
@@ -383,6 +503,15 @@ static void pr_stats(void)
     tx = (s.rd + s.not_rd + s.in + s.not_in + s.rm + s.not_rm) / 1e6 / duration;
     printf(" Throughput:        %.2f MT/s\n", tx);
     printf(" Throughput/thread: %.2f MT/s/thread\n", tx / n_rw_threads);
+
+    if (qht_mode & QHT_MODE_AUTO_RESIZE) {
+        qht_statistics_init(&ht, &ht_stats);
+        printf(" Final head buckets: %zu\n", ht_stats.head_buckets);
+        qht_statistics_destroy(&ht_stats);
+    }
+    if (measure_latency) {
+        pr_lat_stats();
+    }
 }
 
 static void run_test(void)
@@ -412,7 +541,7 @@ static void parse_args(int argc, char *argv[])
     int c;
 
     for (;;) {
-        c = getopt(argc, argv, "d:D:g:k:K:l:hn:N:o:r:Rs:S:u:");
+        c = getopt(argc, argv, "d:D:g:k:K:l:hn:N:o:pr:Rs:S:u:");
         if (c < 0) {
             break;
         }
@@ -451,6 +580,9 @@ static void parse_args(int argc, char *argv[])
         case 'o':
             populate_offset = atol(optarg);
             break;
+        case 'p':
+            measure_latency = true;
+            break;
         case 'r':
             update_range = pow2ceil(atol(optarg));
             break;
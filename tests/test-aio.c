@@ -510,6 +510,324 @@ static void test_timer_schedule(void)
     timer_del(&data.timer);
 }
 
+/* Timer list heap tests.  They use a separate timer list on the realtime
+ * clock; timers meant to fire get expire times in the past.
+ */
+
+#define HEAP_TEST_TIMERS 64
+
+typedef struct {
+    QEMUTimer timer;
+    int id;
+} HeapTestTimer;
+
+static int heap_test_order[HEAP_TEST_TIMERS];
+static int heap_test_fired;
+
+static void heap_test_cb(void *opaque)
+{
+    HeapTestTimer *t = opaque;
+
+    g_assert_cmpint(heap_test_fired, <, HEAP_TEST_TIMERS);
+    heap_test_order[heap_test_fired++] = t->id;
+}
+
+static void heap_test_notify(void *opaque, QEMUClockType type)
+{
+}
+
+static QEMUTimerList *heap_test_init(HeapTestTimer *timers, int n)
+{
+    QEMUTimerList *tl;
+    int i;
+
+    tl = timerlist_new(QEMU_CLOCK_REALTIME, heap_test_notify, NULL);
+    for (i = 0; i < n; i++) {
+        timers[i].id = i;
+        timer_init_tl(&timers[i].timer, tl, SCALE_NS, heap_test_cb,
+                      &timers[i]);
+    }
+    heap_test_fired = 0;
+    return tl;
+}
+
+static void heap_test_cleanup(QEMUTimerList *tl, HeapTestTimer *timers, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        timer_del(&timers[i].timer);
+        timer_deinit(&timers[i].timer);
+    }
+    timerlist_free(tl);
+}
+
+/* Check the deadline of @tl against a timer expiring at @expire_time */
+static void heap_test_check_deadline(QEMUTimerList *tl, int64_t expire_time)
+{
+    int64_t before = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    int64_t deadline = timerlist_deadline_ns(tl);
+    int64_t after = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
+    g_assert_cmpint(deadline, <=, expire_time - before);
+    g_assert_cmpint(deadline, >=, expire_time - after);
+}
+
+static void test_timer_heap_fifo(void)
+{
+    HeapTestTimer timers[HEAP_TEST_TIMERS];
+    QEMUTimerList *tl = heap_test_init(timers, HEAP_TEST_TIMERS);
+    int64_t base = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - SCALE_MS;
+    int group, i, k;
+
+    /* Four groups of timers with the same expire time, armed interleaved */
+    for (i = 0; i < HEAP_TEST_TIMERS; i++) {
+        timer_mod_ns(&timers[i].timer, base - i % 4);
+    }
+
+    g_assert(timerlist_run_timers(tl));
+    g_assert_cmpint(heap_test_fired, ==, HEAP_TEST_TIMERS);
+
+    /* Earliest group first; within a group, in the order they were armed */
+    k = 0;
+    for (group = 3; group >= 0; group--) {
+        for (i = group; i < HEAP_TEST_TIMERS; i += 4) {
+            g_assert_cmpint(heap_test_order[k++], ==, i);
+        }
+    }
+
+    heap_test_cleanup(tl, timers, HEAP_TEST_TIMERS);
+}
+
+/* Expire times are a permutation of the ids, so the heap is not sorted */
+static int heap_test_key(int i)
+{
+    return (i * 37) % HEAP_TEST_TIMERS;
+}
+
+static void test_timer_heap_delete(void)
+{
+    HeapTestTimer timers[HEAP_TEST_TIMERS];
+    QEMUTimerList *tl = heap_test_init(timers, HEAP_TEST_TIMERS);
+    int64_t base = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - SCALE_MS;
+    bool deleted[HEAP_TEST_TIMERS] = { false };
+    int n_deleted = 0;
+    int i;
+
+    for (i = 0; i < HEAP_TEST_TIMERS; i++) {
+        timer_mod_ns(&timers[i].timer, base - HEAP_TEST_TIMERS +
+                     heap_test_key(i));
+    }
+
+    /* Delete the timer in the middle of the heap, then every third one */
+    for (i = 0; i < HEAP_TEST_TIMERS; i++) {
+        if (timers[i].timer.heap_index == HEAP_TEST_TIMERS / 2) {
+            break;
+        }
+    }
+    g_assert_cmpint(i, <, HEAP_TEST_TIMERS);
+    timer_del(&timers[i].timer);
+    g_assert(!timer_pending(&timers[i].timer));
+    deleted[i] = true;
+    n_deleted++;
+
+    for (i = 1; i < HEAP_TEST_TIMERS; i += 3) {
+        if (!deleted[i]) {
+            timer_del(&timers[i].timer);
+            deleted[i] = true;
+            n_deleted++;
+        }
+    }
+
+    g_assert(timerlist_run_timers(tl));
+    g_assert_cmpint(heap_test_fired, ==, HEAP_TEST_TIMERS - n_deleted);
+    for (i = 0; i < heap_test_fired; i++) {
+        g_assert(!deleted[heap_test_order[i]]);
+        if (i > 0) {
+            g_assert_cmpint(heap_test_key(heap_test_order[i - 1]), <,
+                            heap_test_key(heap_test_order[i]));
+        }
+    }
+
+    heap_test_cleanup(tl, timers, HEAP_TEST_TIMERS);
+}
+
+static void test_timer_heap_rearm(void)
+{
+    HeapTestTimer timers[HEAP_TEST_TIMERS];
+    QEMUTimerList *tl = heap_test_init(timers, HEAP_TEST_TIMERS);
+    int64_t base = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - SCALE_MS;
+    const int last = HEAP_TEST_TIMERS - 1;
+    int i, k;
+
+    /* Timer i expires at base - i, so they fire from last down to 0 */
+    for (i = 0; i < HEAP_TEST_TIMERS; i++) {
+        timer_mod_ns(&timers[i].timer, base - i);
+    }
+
+    /* Move a pending timer to the front, and the first one to the back,
+     * where it ties with timer 0 and must fire after it.
+     */
+    timer_mod_ns(&timers[10].timer, base - HEAP_TEST_TIMERS);
+    timer_mod_ns(&timers[last].timer, base);
+    g_assert_cmpint(timer_expire_time_ns(&timers[last].timer), ==, base);
+
+    g_assert(timerlist_run_timers(tl));
+    g_assert_cmpint(heap_test_fired, ==, HEAP_TEST_TIMERS);
+
+    k = 0;
+    g_assert_cmpint(heap_test_order[k++], ==, 10);
+    for (i = last - 1; i >= 0; i--) {
+        if (i != 10) {
+            g_assert_cmpint(heap_test_order[k++], ==, i);
+        }
+    }
+    g_assert_cmpint(heap_test_order[k++], ==, last);
+
+    heap_test_cleanup(tl, timers, HEAP_TEST_TIMERS);
+}
+
+static void test_timer_heap_grow(void)
+{
+    const int n = 1000;
+    HeapTestTimer *timers = g_new0(HeapTestTimer, n);
+    QEMUTimerList *tl = heap_test_init(timers, n);
+    int64_t base = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+                   3600 * NANOSECONDS_PER_SECOND;
+    int i;
+
+    /* Well past the initial size of the heap, in scrambled order */
+    for (i = 0; i < n; i++) {
+        timer_mod_ns(&timers[i].timer, base + (i * 7919) % n * SCALE_US);
+    }
+    heap_test_check_deadline(tl, base);
+
+    /* Drop the earlier half */
+    for (i = 0; i < n; i++) {
+        if ((i * 7919) % n < n / 2) {
+            timer_del(&timers[i].timer);
+        }
+    }
+    heap_test_check_deadline(tl, base + n / 2 * SCALE_US);
+
+    timer_mod_ns(&timers[0].timer, base - SCALE_US);
+    heap_test_check_deadline(tl, base - SCALE_US);
+
+    g_assert(!timerlist_run_timers(tl));
+    g_assert_cmpint(heap_test_fired, ==, 0);
+
+    heap_test_cleanup(tl, timers, n);
+    g_free(timers);
+}
+
+#ifndef _WIN32
+typedef struct {
+    EventNotifier e;
+    int n_read;
+    int n_poll_begin;
+    int n_poll_end;
+} PollIdleTestData;
+
+static void poll_idle_read(EventNotifier *e)
+{
+    PollIdleTestData *data = container_of(e, PollIdleTestData, e);
+
+    event_notifier_test_and_clear(e);
+    data->n_read++;
+}
+
+static bool poll_idle_poll(void *opaque)
+{
+    return false;
+}
+
+static void poll_idle_begin(EventNotifier *e)
+{
+    PollIdleTestData *data = container_of(e, PollIdleTestData, e);
+
+    data->n_poll_begin++;
+}
+
+static void poll_idle_end(EventNotifier *e)
+{
+    PollIdleTestData *data = container_of(e, PollIdleTestData, e);
+
+    data->n_poll_end++;
+}
+
+static void dummy_timer_cb(void *opaque)
+{
+}
+
+/* Run the event loop until a 1 ms timer expires, busy polling meanwhile */
+static void poll_idle_iteration(QEMUTimer *timer)
+{
+    timer_mod(timer, qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + SCALE_MS);
+    while (timer_pending(timer)) {
+        aio_poll(ctx, true);
+    }
+}
+
+static void test_poll_idle(void)
+{
+    PollIdleTestData data = { .n_read = 0 };
+    int64_t old_idle_ns = ctx->poll_idle_ns;
+    QEMUTimer timer;
+    uint64_t misses;
+    int begin, i;
+
+    event_notifier_init(&data.e, false);
+    aio_set_event_notifier(ctx, &data.e, false,
+                           poll_idle_read, poll_idle_poll);
+    aio_set_event_notifier_poll(ctx, &data.e,
+                                poll_idle_begin, poll_idle_end);
+    aio_timer_init(ctx, &timer, QEMU_CLOCK_REALTIME, SCALE_NS,
+                   dummy_timer_cb, NULL);
+
+    ctx->poll_idle_ns = SCALE_MS;
+    aio_context_set_poll_params(ctx, 4 * SCALE_MS, 0, 0, &error_abort);
+
+    /* The handler never makes progress, so it stops being busy polled;
+     * io_poll_begin() is then skipped when polling starts.
+     */
+    for (i = 0; ; i++) {
+        g_assert_cmpint(i, <, 1000);
+        misses = ctx->poll_misses;
+        begin = data.n_poll_begin;
+        poll_idle_iteration(&timer);
+        if (ctx->poll_misses != misses && data.n_poll_begin == begin) {
+            break;
+        }
+    }
+    g_assert_cmpint(data.n_poll_begin, ==, data.n_poll_end);
+
+    /* Once its fd is ready again, it is busy polled again */
+    event_notifier_set(&data.e);
+    for (i = 0; data.n_read == 0; i++) {
+        g_assert_cmpint(i, <, 1000);
+        poll_idle_iteration(&timer);
+    }
+    for (i = 0; ; i++) {
+        g_assert_cmpint(i, <, 1000);
+        misses = ctx->poll_misses;
+        begin = data.n_poll_begin;
+        poll_idle_iteration(&timer);
+        if (ctx->poll_misses != misses) {
+            break;
+        }
+    }
+    g_assert_cmpint(data.n_poll_begin, >, begin);
+    g_assert_cmpint(data.n_poll_begin, ==, data.n_poll_end);
+
+    aio_context_set_poll_params(ctx, 0, 0, 0, &error_abort);
+    ctx->poll_idle_ns = old_idle_ns;
+
+    timer_del(&timer);
+    aio_set_event_notifier(ctx, &data.e, false, NULL, NULL);
+    event_notifier_cleanup(&data.e);
+}
+#endif
+
 /* Now the same tests, using the context as a GSource.  They are
  * very similar to the ones above, with g_main_context_iteration
  * replacing aio_poll.  However:
@@ -863,6 +1181,13 @@ int main(int argc, char **argv)
     g_test_add_func("/aio/event/flush",             test_flush_event_notifier);
     g_test_add_func("/aio/external-client",         test_aio_external_client);
     g_test_add_func("/aio/timer/schedule",          test_timer_schedule);
+    g_test_add_func("/aio/timer/heap/fifo",         test_timer_heap_fifo);
+    g_test_add_func("/aio/timer/heap/delete",       test_timer_heap_delete);
+    g_test_add_func("/aio/timer/heap/rearm",        test_timer_heap_rearm);
+    g_test_add_func("/aio/timer/heap/grow",         test_timer_heap_grow);
+#ifndef _WIN32
+    g_test_add_func("/aio/poll/idle",               test_poll_idle);
+#endif
 
     g_test_add_func("/aio-gsource/flush",                   test_source_flush);
     g_test_add_func("/aio-gsource/bh/schedule",             test_source_bh_schedule);
@@ -69,10 +69,41 @@ static void test_2(void)
     }
 }
 
+static void test_run(void)
+{
+    size_t n, k;
+    bool is_zero;
+
+    for (n = 1; n <= 16; n++) {
+        /* A non-zero chunk ends a run of zero chunks.  */
+        for (k = 0; k < n; k++) {
+            buffer[k * 512 + 300] = 1;
+            g_assert_cmpint(buffer_is_zero_run(buffer, 512, n, &is_zero), ==,
+                            k ? k : 1);
+            g_assert(is_zero == (k != 0));
+            buffer[k * 512 + 300] = 0;
+        }
+        g_assert_cmpint(buffer_is_zero_run(buffer, 512, n, &is_zero), ==, n);
+        g_assert(is_zero);
+
+        /* A zero chunk ends a run of non-zero chunks.  */
+        memset(buffer, 1, n * 512);
+        for (k = 0; k < n; k++) {
+            memset(buffer + k * 512, 0, 512);
+            g_assert_cmpint(buffer_is_zero_run(buffer, 512, n, &is_zero), ==,
+                            k ? k : 1);
+            g_assert(is_zero == (k == 0));
+            memset(buffer + k * 512, 1, 512);
+        }
+        memset(buffer, 0, n * 512);
+    }
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/cutils/bufferiszero", test_2);
+    g_test_add_func("/cutils/bufferiszero/run", test_run);
 
     return g_test_run();
 }
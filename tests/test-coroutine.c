@@ -224,6 +224,32 @@ static void test_lifecycle(void)
     g_assert(done); /* expect done to be true (second time) */
 }
 
+/*
+ * Check that terminated coroutines are reused instead of reallocated
+ */
+
+static void test_pool_reuse(void)
+{
+    CoroutinePoolStats before, after;
+    Coroutine *coroutine;
+    bool done;
+    int i;
+
+    qemu_coroutine_get_pool_stats(&before);
+    for (i = 0; i < 1000; i++) {
+        done = false;
+        coroutine = qemu_coroutine_create(set_and_exit, &done);
+        qemu_coroutine_enter(coroutine);
+        g_assert(done);
+    }
+    qemu_coroutine_get_pool_stats(&after);
+
+    g_assert_cmpuint(after.allocated - before.allocated, <=,
+                     before.batch_size * 2 + 1);
+    g_assert_cmpuint(after.freed, ==, before.freed);
+    g_assert_cmpuint(after.refills, >, before.refills);
+}
+
 
 #define RECORD_SIZE 10 /* Leave some room for expansion */
 struct coroutine_position {
@@ -424,6 +450,7 @@ int main(int argc, char **argv)
      */
     if (CONFIG_COROUTINE_POOL) {
         g_test_add_func("/basic/co_queue", test_co_queue);
+        g_test_add_func("/basic/pool_reuse", test_pool_reuse);
     }
 
     g_test_add_func("/basic/lifecycle", test_lifecycle);
@@ -0,0 +1,82 @@
+/*
+ * QEMU crc32c test
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/crc32c.h"
+
+static uint8_t buffer[4096 + 64];
+
+/* Bit-at-a-time reference implementation.  */
+static uint32_t crc32c_ref(uint32_t crc, const uint8_t *data, size_t len)
+{
+    int k;
+
+    while (len--) {
+        crc ^= *data++;
+        for (k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0x82F63B78 & -(crc & 1));
+        }
+    }
+    return crc ^ 0xffffffff;
+}
+
+static void test_vectors(void)
+{
+    int i;
+
+    /* RFC 3720, section B.4 */
+    memset(buffer, 0, 32);
+    g_assert_cmphex(crc32c(0xffffffff, buffer, 32), ==, 0x8a9136aa);
+    memset(buffer, 0xff, 32);
+    g_assert_cmphex(crc32c(0xffffffff, buffer, 32), ==, 0x62a8ab43);
+    for (i = 0; i < 32; i++) {
+        buffer[i] = i;
+    }
+    g_assert_cmphex(crc32c(0xffffffff, buffer, 32), ==, 0x46dd794e);
+    for (i = 0; i < 32; i++) {
+        buffer[i] = 31 - i;
+    }
+    g_assert_cmphex(crc32c(0xffffffff, buffer, 32), ==, 0x113fdb5c);
+
+    g_assert_cmphex(crc32c(0xffffffff, (const uint8_t *)"123456789", 9),
+                    ==, 0xe3069283);
+}
+
+static void test_random(void)
+{
+    size_t a, s;
+
+    for (s = 0; s < sizeof(buffer); s++) {
+        buffer[s] = g_test_rand_int();
+    }
+
+    /* Every alignment, and every length up to a few words past it.  */
+    for (a = 0; a < 16; a++) {
+        for (s = 0; s < 256; s++) {
+            g_assert_cmphex(crc32c(0xffffffff, buffer + a, s), ==,
+                            crc32c_ref(0xffffffff, buffer + a, s));
+        }
+    }
+    g_assert_cmphex(crc32c(0, buffer + 3, 4096), ==,
+                    crc32c_ref(0, buffer + 3, 4096));
+}
+
+static void test_crc32c(void)
+{
+    do {
+        test_vectors();
+        test_random();
+    } while (test_crc32c_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/crc32c/accel", test_crc32c);
+
+    return g_test_run();
+}
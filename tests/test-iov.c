@@ -145,6 +145,46 @@ static void test_to_from_buf(void)
     }
 }
 
+static void test_copy(void)
+{
+    struct iovec *iov;
+    struct iovec *dst;
+    unsigned niov, ndst;
+    unsigned char *ibuf, *obuf;
+    size_t sz, i, j, n;
+
+    iov_random(&iov, &niov);
+    sz = iov_size(iov, niov);
+    dst = g_new(struct iovec, niov);
+    ibuf = g_malloc(sz);
+    obuf = g_malloc(sz);
+
+    for (i = 0; i < sz; ++i) {
+        ibuf[i] = i & 255;
+    }
+    iov_from_buf(iov, niov, 0, ibuf, sz);
+
+    for (i = 0; i < sz; ++i) {
+        for (j = 1; i + j <= sz; ++j) {
+            /* dst must describe exactly bytes [i..i+j) of iov */
+            ndst = iov_copy(dst, niov, iov, niov, i, j);
+            g_assert(ndst >= 1 && ndst <= niov);
+            g_assert(iov_size(dst, ndst) == j);
+            n = iov_to_buf(dst, ndst, 0, obuf, j);
+            g_assert(n == j);
+            g_assert(memcmp(obuf, ibuf + i, j) == 0);
+        }
+    }
+
+    /* a range that starts at the end of the iovec yields no elements */
+    g_assert(iov_copy(dst, niov, iov, niov, sz, 0) == 0);
+
+    g_free(obuf);
+    g_free(ibuf);
+    g_free(dst);
+    iov_free(iov, niov);
+}
+
 static void test_io(void)
 {
 #ifndef _WIN32
@@ -409,6 +449,7 @@ int main(int argc, char **argv)
     g_test_init(&argc, &argv, NULL);
     g_test_rand_int();
     g_test_add_func("/basic/iov/from-to-buf", test_to_from_buf);
+    g_test_add_func("/basic/iov/copy", test_copy);
     g_test_add_func("/basic/iov/io", test_io);
     g_test_add_func("/basic/iov/discard-front", test_discard_front);
     g_test_add_func("/basic/iov/discard-back", test_discard_back);
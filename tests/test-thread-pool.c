@@ -33,6 +33,16 @@ static int long_cb(void *opaque)
     return 0;
 }
 
+static int blocking_cb(void *opaque)
+{
+    WorkerTestData *data = opaque;
+    atomic_inc(&data->n);
+    while (atomic_read(&data->n) == 1) {
+        g_usleep(1000);
+    }
+    return 0;
+}
+
 static void done_cb(void *opaque, int ret)
 {
     WorkerTestData *data = opaque;
@@ -222,6 +232,89 @@ static void test_cancel_async(void)
     do_test_cancel(false);
 }
 
+static void test_thread_pool_params(void)
+{
+    WorkerTestData data = { .n = 0 };
+    ThreadPoolStats stats;
+    Error *err = NULL;
+    uint64_t requests;
+
+    aio_context_set_thread_pool_params(ctx, 8, 4, &err);
+    error_free_or_abort(&err);
+
+    /* min_threads workers are spawned without waiting for requests */
+    aio_context_set_thread_pool_params(ctx, 4, 8, &error_abort);
+    thread_pool_get_stats(pool, &stats);
+    g_assert_cmpint(stats.threads, >=, 4);
+    requests = stats.requests;
+
+    thread_pool_submit(pool, worker_cb, &data);
+    while (data.n == 0) {
+        aio_poll(ctx, true);
+    }
+    thread_pool_get_stats(pool, &stats);
+    g_assert_cmpint(stats.requests, ==, requests + 1);
+
+    aio_context_set_thread_pool_params(ctx, 0, THREAD_POOL_MAX_THREADS_DEFAULT,
+                                       &error_abort);
+}
+
+static void test_work_stealing(void)
+{
+    WorkerTestData blocker = { .n = 0, .ret = -EINPROGRESS };
+    WorkerTestData data[8];
+    ThreadPoolStats stats;
+    uint64_t steals;
+    int i;
+
+    /* Two workers, each with its own queue */
+    aio_context_set_thread_pool_params(ctx, 2, 2, &error_abort);
+    for (;;) {
+        thread_pool_get_stats(pool, &stats);
+        if (stats.threads == 2 && stats.idle_threads == 2) {
+            break;
+        }
+        aio_poll(ctx, false);
+        g_usleep(1000);
+    }
+    steals = stats.steals;
+
+    /* Keep one worker busy... */
+    thread_pool_submit_aio(pool, blocking_cb, &blocker, done_cb, &blocker);
+    while (atomic_read(&blocker.n) == 0) {
+        g_usleep(1000);
+    }
+
+    /* ... so that the other has to take the requests queued behind it.  */
+    for (i = 0; i < 8; i++) {
+        data[i].n = 0;
+        data[i].ret = -EINPROGRESS;
+        thread_pool_submit_aio(pool, worker_cb, &data[i], done_cb, &data[i]);
+    }
+
+    active = 8;
+    while (active > 0) {
+        aio_poll(ctx, true);
+    }
+    for (i = 0; i < 8; i++) {
+        g_assert_cmpint(data[i].n, ==, 1);
+        g_assert_cmpint(data[i].ret, ==, 0);
+    }
+    g_assert_cmpint(blocker.ret, ==, -EINPROGRESS);
+    thread_pool_get_stats(pool, &stats);
+    g_assert_cmpint(stats.steals, >, steals);
+
+    atomic_set(&blocker.n, 2);
+    active = 1;
+    while (active > 0) {
+        aio_poll(ctx, true);
+    }
+    g_assert_cmpint(blocker.ret, ==, 0);
+
+    aio_context_set_thread_pool_params(ctx, 0, THREAD_POOL_MAX_THREADS_DEFAULT,
+                                       &error_abort);
+}
+
 int main(int argc, char **argv)
 {
     int ret;
@@ -237,6 +330,8 @@ int main(int argc, char **argv)
     g_test_add_func("/thread-pool/submit-many", test_submit_many);
     g_test_add_func("/thread-pool/cancel", test_cancel);
     g_test_add_func("/thread-pool/cancel-async", test_cancel_async);
+    g_test_add_func("/thread-pool/params", test_thread_pool_params);
+    g_test_add_func("/thread-pool/work-stealing", test_work_stealing);
 
     ret = g_test_run();
 
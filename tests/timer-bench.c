@@ -0,0 +1,167 @@
+/*
+ * Micro-benchmark for QEMU timer lists
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+
+/* keep every timer well in the future, so that none of them fires */
+#define EXPIRE_OFFSET (3600 * NANOSECONDS_PER_SECOND)
+
+static QEMUTimerList *timer_list;
+static QEMUTimer *timers;
+static unsigned int n_timers = 1024;
+static unsigned int duration = 1;
+static int64_t range = 1000000;
+static unsigned int deadline_every = 1;
+
+static const char commands_string[] =
+    " -d = duration in seconds\n"
+    " -n = number of armed timers\n"
+    " -r = range of expire times, in ns\n"
+    " -D = query the deadline every this many rearms (0 = never)";
+
+static void usage_complete(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+}
+
+/*
+ * From: https://en.wikipedia.org/wiki/Xorshift
+ * This is faster than rand_r(), and gives us a wider range (RAND_MAX is only
+ * guaranteed to be >= INT_MAX).
+ */
+static uint64_t xorshift64star(uint64_t x)
+{
+    x ^= x >> 12; /* a */
+    x ^= x << 25; /* b */
+    x ^= x >> 27; /* c */
+    return x * UINT64_C(2685821657736338717);
+}
+
+static void timer_cb(void *opaque)
+{
+}
+
+static void notify_cb(void *opaque, QEMUClockType type)
+{
+}
+
+static void create_timers(void)
+{
+    int64_t base = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + EXPIRE_OFFSET;
+    uint64_t r = time(NULL);
+    unsigned int i;
+
+    timer_list = timerlist_new(QEMU_CLOCK_REALTIME, notify_cb, NULL);
+    timers = g_new0(QEMUTimer, n_timers);
+    for (i = 0; i < n_timers; i++) {
+        r = xorshift64star(r);
+        timer_init_tl(&timers[i], timer_list, SCALE_NS, timer_cb, NULL);
+        timer_mod_ns(&timers[i], base + r % range);
+    }
+}
+
+static void destroy_timers(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < n_timers; i++) {
+        timer_del(&timers[i]);
+        timer_deinit(&timers[i]);
+    }
+    timerlist_free(timer_list);
+    g_free(timers);
+}
+
+static void run_test(uint64_t *n_ops, uint64_t *n_deadlines)
+{
+    int64_t base = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + EXPIRE_OFFSET;
+    int64_t end = get_clock() + duration * NANOSECONDS_PER_SECOND;
+    uint64_t r = time(NULL);
+    uint64_t ops = 0;
+    uint64_t deadlines = 0;
+    int64_t deadline = 0;
+
+    do {
+        unsigned int i;
+
+        for (i = 0; i < 1024; i++) {
+            r = xorshift64star(r);
+            timer_mod_ns(&timers[r % n_timers], base + (r >> 32) % range);
+            ops++;
+            if (deadline_every && ops % deadline_every == 0) {
+                deadline += timerlist_deadline_ns(timer_list);
+                deadlines++;
+            }
+        }
+    } while (get_clock() < end);
+
+    /* make sure that the deadline queries are not optimized away */
+    g_assert(deadline >= 0);
+    *n_ops = ops;
+    *n_deadlines = deadlines;
+}
+
+static void pr_params(void)
+{
+    printf("Parameters:\n");
+    printf(" duration:          %u s\n", duration);
+    printf(" # of timers:       %u\n", n_timers);
+    printf(" expire range:      %" PRId64 " ns\n", range);
+    printf(" deadline every:    %u rearms\n", deadline_every);
+}
+
+static void pr_stats(uint64_t n_ops, uint64_t n_deadlines)
+{
+    printf("Results:\n");
+    printf(" Rearms:            %.2f M\n", n_ops / 1e6);
+    printf(" Deadline queries:  %.2f M\n", n_deadlines / 1e6);
+    printf(" Throughput:        %.2f Mrearms/s\n", n_ops / 1e6 / duration);
+    printf(" Time per rearm:    %.2f ns\n", duration * 1e9 / n_ops);
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "hd:D:n:r:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'h':
+            usage_complete(argv);
+            exit(0);
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'D':
+            deadline_every = atoi(optarg);
+            break;
+        case 'n':
+            n_timers = MAX(atoi(optarg), 1);
+            break;
+        case 'r':
+            range = MAX(atoll(optarg), 1);
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t n_ops, n_deadlines;
+
+    parse_args(argc, argv);
+    pr_params();
+    create_timers();
+    run_test(&n_ops, &n_deadlines);
+    destroy_timers();
+    pr_stats(n_ops, n_deadlines);
+    return 0;
+}
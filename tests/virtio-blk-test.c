@@ -22,6 +22,8 @@
 #include "standard-headers/linux/virtio_ring.h"
 #include "standard-headers/linux/virtio_blk.h"
 #include "standard-headers/linux/virtio_pci.h"
+#include "hw/pci/pci_regs.h"
+#include "hw/virtio/virtio-ring-packed.h"
 
 #define TEST_IMAGE_SIZE         (64 * 1024 * 1024)
 #define QVIRTIO_BLK_TIMEOUT_US  (30 * 1000 * 1000)
@@ -29,6 +31,8 @@
 #define PCI_SLOT                0x04
 #define PCI_FN                  0x00
 
+#define PACKED_QUEUE_SIZE       8
+
 #define MMIO_PAGE_SIZE          4096
 #define MMIO_DEV_BASE_ADDR      0x0A003E00
 #define MMIO_RAM_ADDR           0x40000000
@@ -650,6 +654,488 @@ static void pci_idx(void)
     qtest_shutdown(qs);
 }
 
+/* Submit one write on each of two virtqueues so that both fail and stop
+ * the VM.  On resume the two requests are resubmitted from s->rq, merged
+ * into a single chain, and each must still complete on its own queue.
+ */
+static void pci_mq_stop_resume(void)
+{
+    QVirtioPCIDevice *dev;
+    QOSState *qs;
+    QVirtQueuePCI *vqpci[2];
+    QVirtioBlkReq req;
+    uint64_t req_addr[2];
+    uint32_t free_head[2];
+    uint32_t features;
+    uint8_t status;
+    char *tmp_path;
+    char debug_path[] = "/tmp/qtest-blkdebug.XXXXXX";
+    FILE *debug_file;
+    int fd, i;
+
+    /* Fail every write until the first read moves blkdebug to state 2.  */
+    fd = mkstemp(debug_path);
+    g_assert_cmpint(fd, >=, 0);
+    debug_file = fdopen(fd, "w");
+    g_assert(debug_file);
+    fprintf(debug_file, "[inject-error]\n");
+    fprintf(debug_file, "event = \"write_aio\"\n");
+    fprintf(debug_file, "errno = \"5\"\n");
+    fprintf(debug_file, "state = \"1\"\n");
+    fprintf(debug_file, "[set-state]\n");
+    fprintf(debug_file, "event = \"read_aio\"\n");
+    fprintf(debug_file, "state = \"1\"\n");
+    fprintf(debug_file, "new_state = \"2\"\n");
+    g_assert_cmpint(fclose(debug_file), ==, 0);
+
+    tmp_path = drive_create();
+    qs = qtest_pc_boot("-drive if=none,id=drive0,file=blkdebug:%s:%s,"
+                       "format=raw,werror=stop,rerror=stop "
+                       "-device virtio-blk-pci,id=drv0,drive=drive0,"
+                       "num-queues=2,addr=%x.%x",
+                       debug_path, tmp_path, PCI_SLOT, PCI_FN);
+    unlink(tmp_path);
+    g_free(tmp_path);
+
+    dev = virtio_blk_pci_init(qs->pcibus, PCI_SLOT);
+    qpci_msix_enable(dev->pdev);
+
+    qvirtio_pci_set_msix_configuration_vector(dev, qs->alloc, 0);
+
+    features = qvirtio_get_features(&dev->vdev);
+    features = features & ~(QVIRTIO_F_BAD_FEATURE |
+                            (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                            (1u << VIRTIO_RING_F_EVENT_IDX) |
+                            (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(&dev->vdev, features);
+
+    for (i = 0; i < 2; i++) {
+        vqpci[i] = (QVirtQueuePCI *)qvirtqueue_setup(&dev->vdev, qs->alloc, i);
+        qvirtqueue_pci_msix_setup(dev, vqpci[i], qs->alloc, i + 1);
+    }
+
+    qvirtio_set_driver_ok(&dev->vdev);
+
+    /* Adjacent write requests, one per queue */
+    for (i = 0; i < 2; i++) {
+        req.type = VIRTIO_BLK_T_OUT;
+        req.ioprio = 1;
+        req.sector = i;
+        req.data = g_malloc0(512);
+        strcpy(req.data, "TEST");
+
+        req_addr[i] = virtio_blk_request(qs->alloc, &dev->vdev, &req, 512);
+
+        g_free(req.data);
+
+        free_head[i] = qvirtqueue_add(&vqpci[i]->vq, req_addr[i], 16,
+                                      false, true);
+        qvirtqueue_add(&vqpci[i]->vq, req_addr[i] + 16, 512, false, true);
+        qvirtqueue_add(&vqpci[i]->vq, req_addr[i] + 528, 1, true, false);
+    }
+    for (i = 0; i < 2; i++) {
+        qvirtqueue_kick(&dev->vdev, &vqpci[i]->vq, free_head[i]);
+    }
+
+    qmp_eventwait("STOP");
+
+    /* Stop injecting errors and resume */
+    g_free(hmp("qemu-io drive0 \"read 0 512\""));
+    qmp_discard_response("{ 'execute': 'cont' }");
+
+    for (i = 0; i < 2; i++) {
+        qvirtio_wait_used_elem(&dev->vdev, &vqpci[i]->vq, free_head[i],
+                               QVIRTIO_BLK_TIMEOUT_US);
+
+        status = readb(req_addr[i] + 528);
+        g_assert_cmpint(status, ==, 0);
+
+        guest_free(qs->alloc, req_addr[i]);
+    }
+
+    /* End test */
+    for (i = 0; i < 2; i++) {
+        qvirtqueue_cleanup(dev->vdev.bus, &vqpci[i]->vq, qs->alloc);
+    }
+    qpci_msix_disable(dev->pdev);
+    qvirtio_pci_device_disable(dev);
+    qvirtio_pci_device_free(dev);
+    qtest_shutdown(qs);
+    unlink(debug_path);
+}
+
+/* libqos only drives the legacy virtio-pci interface, which cannot
+ * negotiate feature bits above 31.  The packed ring test uses this
+ * minimal virtio 1.0 driver instead.
+ */
+typedef struct QVirtioPackedPCI {
+    QVirtioPCIDevice *dev;
+    QPCIBar bar;
+    uint64_t common;
+    uint64_t isr;
+    uint64_t notify;
+
+    uint64_t desc;
+    uint64_t driver_event;
+    uint64_t device_event;
+    uint16_t avail_idx;
+    bool avail_wrap;
+    uint16_t used_idx;
+    bool used_wrap;
+
+    /* Chain length of each buffer, indexed by id */
+    uint16_t ndescs[PACKED_QUEUE_SIZE];
+} QVirtioPackedPCI;
+
+static void packed_common_writeb(QVirtioPackedPCI *p, uint64_t off,
+                                 uint8_t val)
+{
+    qpci_io_writeb(p->dev->pdev, p->bar, p->common + off, val);
+}
+
+static void packed_common_writew(QVirtioPackedPCI *p, uint64_t off,
+                                 uint16_t val)
+{
+    qpci_io_writew(p->dev->pdev, p->bar, p->common + off, val);
+}
+
+static void packed_common_writel(QVirtioPackedPCI *p, uint64_t off,
+                                 uint32_t val)
+{
+    qpci_io_writel(p->dev->pdev, p->bar, p->common + off, val);
+}
+
+static uint32_t packed_common_readl(QVirtioPackedPCI *p, uint64_t off)
+{
+    return qpci_io_readl(p->dev->pdev, p->bar, p->common + off);
+}
+
+static void packed_pci_init(QVirtioPackedPCI *p, QOSState *qs)
+{
+    QPCIDevice *pdev;
+    uint32_t notify_mult = 0;
+    uint64_t addr;
+    uint8_t cap;
+    uint8_t status;
+    int bar = -1;
+    int i;
+
+    p->dev = qvirtio_pci_device_find_slot(qs->pcibus, VIRTIO_ID_BLOCK,
+                                          PCI_SLOT);
+    g_assert(p->dev != NULL);
+    qvirtio_pci_device_enable(p->dev);
+    pdev = p->dev->pdev;
+
+    for (cap = qpci_config_readb(pdev, PCI_CAPABILITY_LIST); cap;
+         cap = qpci_config_readb(pdev, cap + PCI_CAP_LIST_NEXT)) {
+        uint32_t offset;
+
+        if (qpci_config_readb(pdev, cap) != PCI_CAP_ID_VNDR) {
+            continue;
+        }
+        offset = qpci_config_readl(pdev, cap + VIRTIO_PCI_CAP_OFFSET);
+        switch (qpci_config_readb(pdev, cap + VIRTIO_PCI_CAP_CFG_TYPE)) {
+        case VIRTIO_PCI_CAP_COMMON_CFG:
+            bar = qpci_config_readb(pdev, cap + VIRTIO_PCI_CAP_BAR);
+            p->common = offset;
+            break;
+        case VIRTIO_PCI_CAP_ISR_CFG:
+            p->isr = offset;
+            break;
+        case VIRTIO_PCI_CAP_NOTIFY_CFG:
+            notify_mult = qpci_config_readl(pdev,
+                                            cap + VIRTIO_PCI_NOTIFY_CAP_MULT);
+            p->notify = offset;
+            break;
+        }
+    }
+    g_assert_cmpint(bar, >=, 0);
+    p->bar = qpci_iomap(pdev, bar, NULL);
+
+    packed_common_writeb(p, VIRTIO_PCI_COMMON_STATUS, 0);
+    status = VIRTIO_CONFIG_S_ACKNOWLEDGE | VIRTIO_CONFIG_S_DRIVER;
+    packed_common_writeb(p, VIRTIO_PCI_COMMON_STATUS, status);
+
+    packed_common_writel(p, VIRTIO_PCI_COMMON_DFSELECT, 0);
+    g_assert(packed_common_readl(p, VIRTIO_PCI_COMMON_DF) &
+             (1u << VIRTIO_RING_F_EVENT_IDX));
+    packed_common_writel(p, VIRTIO_PCI_COMMON_DFSELECT, 1);
+    g_assert(packed_common_readl(p, VIRTIO_PCI_COMMON_DF) &
+             (1u << (VIRTIO_F_RING_PACKED - 32)));
+
+    packed_common_writel(p, VIRTIO_PCI_COMMON_GFSELECT, 0);
+    packed_common_writel(p, VIRTIO_PCI_COMMON_GF,
+                         1u << VIRTIO_RING_F_EVENT_IDX);
+    packed_common_writel(p, VIRTIO_PCI_COMMON_GFSELECT, 1);
+    packed_common_writel(p, VIRTIO_PCI_COMMON_GF,
+                         (1u << (VIRTIO_F_VERSION_1 - 32)) |
+                         (1u << (VIRTIO_F_RING_PACKED - 32)));
+    status |= VIRTIO_CONFIG_S_FEATURES_OK;
+    packed_common_writeb(p, VIRTIO_PCI_COMMON_STATUS, status);
+    g_assert_cmphex(qpci_io_readb(pdev, p->bar,
+                                  p->common + VIRTIO_PCI_COMMON_STATUS),
+                    ==, status);
+
+    p->desc = guest_alloc(qs->alloc, PACKED_QUEUE_SIZE * 16);
+    for (i = 0; i < PACKED_QUEUE_SIZE; i++) {
+        writeq(p->desc + 16 * i, 0);
+        writeq(p->desc + 16 * i + 8, 0);
+    }
+    p->driver_event = guest_alloc(qs->alloc, 4);
+    writel(p->driver_event, 0);
+    p->device_event = guest_alloc(qs->alloc, 4);
+    writel(p->device_event, 0);
+
+    packed_common_writew(p, VIRTIO_PCI_COMMON_Q_SELECT, 0);
+    packed_common_writew(p, VIRTIO_PCI_COMMON_Q_SIZE, PACKED_QUEUE_SIZE);
+    for (i = 0, addr = p->desc; i < 3; i++) {
+        static const uint64_t lo[] = {
+            VIRTIO_PCI_COMMON_Q_DESCLO,
+            VIRTIO_PCI_COMMON_Q_AVAILLO,
+            VIRTIO_PCI_COMMON_Q_USEDLO,
+        };
+
+        packed_common_writel(p, lo[i], addr);
+        packed_common_writel(p, lo[i] + 4, addr >> 32);
+        addr = i ? p->device_event : p->driver_event;
+    }
+    p->notify += notify_mult *
+        qpci_io_readw(pdev, p->bar, p->common + VIRTIO_PCI_COMMON_Q_NOFF);
+    packed_common_writew(p, VIRTIO_PCI_COMMON_Q_ENABLE, 1);
+
+    status |= VIRTIO_CONFIG_S_DRIVER_OK;
+    packed_common_writeb(p, VIRTIO_PCI_COMMON_STATUS, status);
+
+    p->avail_idx = p->used_idx = 0;
+    p->avail_wrap = p->used_wrap = true;
+}
+
+static void packed_pci_cleanup(QVirtioPackedPCI *p, QOSState *qs)
+{
+    packed_common_writeb(p, VIRTIO_PCI_COMMON_STATUS, 0);
+    guest_free(qs->alloc, p->desc);
+    guest_free(qs->alloc, p->driver_event);
+    guest_free(qs->alloc, p->device_event);
+    qpci_iounmap(p->dev->pdev, p->bar);
+    qvirtio_pci_device_disable(p->dev);
+    qvirtio_pci_device_free(p->dev);
+}
+
+static bool packed_isr(QVirtioPackedPCI *p)
+{
+    return qpci_io_readb(p->dev->pdev, p->bar, p->isr) & 1;
+}
+
+/* Make a descriptor chain available and return its buffer id, which is
+ * the slot of its first descriptor.  The first descriptor is made
+ * available last, so the device never sees a partial chain.
+ */
+static uint16_t packed_add_chain(QVirtioPackedPCI *p, const uint64_t *addr,
+                                 const uint32_t *len, const bool *write,
+                                 int n)
+{
+    uint16_t head = p->avail_idx;
+    uint16_t head_flags = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        uint64_t desc = p->desc + 16 * p->avail_idx;
+        uint16_t flags = 0;
+
+        if (i < n - 1) {
+            flags |= VRING_DESC_F_NEXT;
+        }
+        if (write[i]) {
+            flags |= VRING_DESC_F_WRITE;
+        }
+        if (p->avail_wrap) {
+            flags |= 1 << VRING_PACKED_DESC_F_AVAIL;
+        } else {
+            flags |= 1 << VRING_PACKED_DESC_F_USED;
+        }
+
+        writeq(desc, addr[i]);
+        writel(desc + 8, len[i]);
+        writew(desc + 12, head);
+        if (i) {
+            writew(desc + 14, flags);
+        } else {
+            head_flags = flags;
+        }
+
+        if (++p->avail_idx == PACKED_QUEUE_SIZE) {
+            p->avail_idx = 0;
+            p->avail_wrap = !p->avail_wrap;
+        }
+    }
+
+    p->ndescs[head] = n;
+    writew(p->desc + 16 * head + 14, head_flags);
+    return head;
+}
+
+static void packed_kick(QVirtioPackedPCI *p)
+{
+    qpci_io_writew(p->dev->pdev, p->bar, p->notify, 0);
+}
+
+/* Return the next used buffer, if the device has written it back */
+static bool packed_get_buf(QVirtioPackedPCI *p, uint16_t *id)
+{
+    uint64_t desc = p->desc + 16 * p->used_idx;
+    uint16_t flags = readw(desc + 14);
+    bool avail = flags & (1 << VRING_PACKED_DESC_F_AVAIL);
+    bool used = flags & (1 << VRING_PACKED_DESC_F_USED);
+
+    if (avail != used || used != p->used_wrap) {
+        return false;
+    }
+
+    *id = readw(desc + 12);
+    p->used_idx += p->ndescs[*id];
+    if (p->used_idx >= PACKED_QUEUE_SIZE) {
+        p->used_idx -= PACKED_QUEUE_SIZE;
+        p->used_wrap = !p->used_wrap;
+    }
+    return true;
+}
+
+/* Wait for buffer id to be used, and check whether it raised an interrupt */
+static void packed_wait_buf(QVirtioPackedPCI *p, uint16_t id, bool isr)
+{
+    gint64 start_time = g_get_monotonic_time();
+    bool got_isr = false;
+    uint16_t got_id;
+
+    for (;;) {
+        clock_step(100);
+        got_isr |= packed_isr(p);
+        if (packed_get_buf(p, &got_id)) {
+            break;
+        }
+        g_assert(g_get_monotonic_time() - start_time <=
+                 QVIRTIO_BLK_TIMEOUT_US);
+    }
+
+    /* The interrupt is raised right after the used descriptor is written */
+    got_isr |= packed_isr(p);
+    g_assert_cmpint(got_id, ==, id);
+    g_assert(got_isr == isr);
+}
+
+static uint64_t packed_blk_submit(QVirtioPackedPCI *p, QGuestAllocator *alloc,
+                                  uint32_t type, uint64_t sector,
+                                  const char *data, uint16_t *id)
+{
+    uint64_t req_addr = guest_alloc(alloc, 16 + 512 + 1);
+    uint64_t addr[3] = { req_addr, req_addr + 16, req_addr + 528 };
+    uint32_t len[3] = { 16, 512, 1 };
+    bool write[3] = { false, type == VIRTIO_BLK_T_IN, true };
+
+    /* virtio 1.0 headers are little endian, like the x86 guest */
+    writel(req_addr, type);
+    writel(req_addr + 4, 0);
+    writeq(req_addr + 8, sector);
+    if (data) {
+        memwrite(req_addr + 16, data, 512);
+    }
+    writeb(req_addr + 528, 0xff);
+
+    *id = packed_add_chain(p, addr, len, write, 3);
+    return req_addr;
+}
+
+/* Drive a packed=on device through several laps of an 8-entry ring.  Each
+ * request takes three descriptors, so chains also straddle the end of the
+ * ring and the used descriptors are written back across the wrap.
+ */
+static void pci_packed(void)
+{
+    QVirtioPackedPCI p;
+    QOSState *qs;
+    uint64_t req_addr[2];
+    uint16_t id[2];
+    char *tmp_path;
+    char data[512];
+    char buf[512];
+    int i;
+
+    tmp_path = drive_create();
+    qs = qtest_pc_boot("-drive if=none,id=drive0,file=%s,format=raw "
+                       "-device virtio-blk-pci,id=drv0,drive=drive0,"
+                       "packed=on,addr=%x.%x",
+                       tmp_path, PCI_SLOT, PCI_FN);
+    unlink(tmp_path);
+    g_free(tmp_path);
+
+    packed_pci_init(&p, qs);
+
+    for (i = 0; i < 8; i++) {
+        memset(data, 0, sizeof(data));
+        snprintf(data, sizeof(data), "TEST%d", i);
+
+        req_addr[0] = packed_blk_submit(&p, qs->alloc, VIRTIO_BLK_T_OUT, i,
+                                        data, &id[0]);
+        packed_kick(&p);
+        packed_wait_buf(&p, id[0], true);
+        g_assert_cmpint(readb(req_addr[0] + 528), ==, 0);
+        guest_free(qs->alloc, req_addr[0]);
+
+        req_addr[0] = packed_blk_submit(&p, qs->alloc, VIRTIO_BLK_T_IN, i,
+                                        NULL, &id[0]);
+        packed_kick(&p);
+        packed_wait_buf(&p, id[0], true);
+        g_assert_cmpint(readb(req_addr[0] + 528), ==, 0);
+        memread(req_addr[0] + 16, buf, sizeof(buf));
+        g_assert_cmpstr(buf, ==, data);
+        guest_free(qs->alloc, req_addr[0]);
+
+        /* With event_idx the device asks to be kicked for the next slot */
+        g_assert_cmphex(readw(p.device_event + 2), ==,
+                        VRING_PACKED_EVENT_FLAG_DESC);
+        g_assert_cmphex(readw(p.device_event), ==,
+                        p.avail_idx |
+                        (p.avail_wrap << VRING_PACKED_EVENT_F_WRAP_CTR));
+    }
+
+    /* No interrupt while the driver disables events */
+    writew(p.driver_event + 2, VRING_PACKED_EVENT_FLAG_DISABLE);
+    req_addr[0] = packed_blk_submit(&p, qs->alloc, VIRTIO_BLK_T_IN, 0,
+                                    NULL, &id[0]);
+    packed_kick(&p);
+    packed_wait_buf(&p, id[0], false);
+    g_assert_cmpint(readb(req_addr[0] + 528), ==, 0);
+    guest_free(qs->alloc, req_addr[0]);
+
+    /* Ask for an interrupt only when the descriptor after the next request
+     * is used.  The second request straddles the end of the ring, so the
+     * event offset is checked against a used index that has wrapped.
+     */
+    g_assert_cmpint(p.avail_idx, ==, 3);
+    req_addr[0] = packed_blk_submit(&p, qs->alloc, VIRTIO_BLK_T_IN, 0,
+                                    NULL, &id[0]);
+    writew(p.driver_event,
+           p.avail_idx | (p.avail_wrap << VRING_PACKED_EVENT_F_WRAP_CTR));
+    writew(p.driver_event + 2, VRING_PACKED_EVENT_FLAG_DESC);
+    packed_kick(&p);
+    packed_wait_buf(&p, id[0], false);
+
+    req_addr[1] = packed_blk_submit(&p, qs->alloc, VIRTIO_BLK_T_IN, 1,
+                                    NULL, &id[1]);
+    packed_kick(&p);
+    packed_wait_buf(&p, id[1], true);
+    g_assert(!p.used_wrap);
+
+    for (i = 0; i < 2; i++) {
+        g_assert_cmpint(readb(req_addr[i] + 528), ==, 0);
+        guest_free(qs->alloc, req_addr[i]);
+    }
+
+    /* End test */
+    packed_pci_cleanup(&p, qs);
+    qtest_shutdown(qs);
+}
+
 static void pci_hotplug(void)
 {
     QVirtioPCIDevice *dev;
@@ -727,6 +1213,9 @@ int main(int argc, char **argv)
         if (strcmp(arch, "i386") == 0 || strcmp(arch, "x86_64") == 0) {
             qtest_add_func("/virtio/blk/pci/msix", pci_msix);
             qtest_add_func("/virtio/blk/pci/idx", pci_idx);
+            qtest_add_func("/virtio/blk/pci/mq-stop-resume",
+                           pci_mq_stop_resume);
+            qtest_add_func("/virtio/blk/pci/packed", pci_packed);
         }
         qtest_add_func("/virtio/blk/pci/hotplug", pci_hotplug);
     } else if (strcmp(arch, "arm") == 0) {
@@ -36,8 +36,18 @@ struct AioHandler
     void *opaque;
     bool is_external;
     QLIST_ENTRY(AioHandler) node;
+
+    /* Busy polling stops calling io_poll after ctx->poll_idle_ns
+     * without progress, until the fd becomes ready again.  0 means the
+     * interval restarts the next time idle handlers are looked for.
+     */
+    int64_t poll_idle_timeout;
+    bool poll_idle;
 };
 
+/* Default for how long a poll handler is busy polled without progress */
+#define POLL_IDLE_INTERVAL_NS (7 * NANOSECONDS_PER_SECOND)
+
 #ifdef CONFIG_EPOLL_CREATE1
 
 /* The fd number threashold to switch to epoll */
@@ -264,6 +274,8 @@ void aio_set_fd_handler(AioContext *ctx,
         }
 
         /* Update handler with latest information */
+        node->poll_idle = false;
+        node->poll_idle_timeout = 0;
         node->io_read = io_read;
         node->io_write = io_write;
         node->io_poll = io_poll;
@@ -331,7 +343,7 @@ static void poll_set_started(AioContext *ctx, bool started)
     QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
         IOHandler *fn;
 
-        if (node->deleted) {
+        if (node->deleted || node->poll_idle) {
             continue;
         }
 
@@ -399,6 +411,17 @@ static bool aio_dispatch_handlers(AioContext *ctx)
         revents = node->pfd.revents & node->pfd.events;
         node->pfd.revents = 0;
 
+        if (revents && node->poll_idle) {
+            /* The handler has work again, poll it from now on */
+            node->poll_idle = false;
+            node->poll_idle_timeout = 0;
+
+            /* poll_set_started() skipped it while it was idle */
+            if (ctx->poll_started && node->io_poll_begin) {
+                node->io_poll_begin(node->opaque);
+            }
+        }
+
         if (!node->deleted &&
             (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR)) &&
             aio_node_check(ctx, node->is_external) &&
@@ -492,9 +515,10 @@ static bool run_poll_handlers_once(AioContext *ctx)
     AioHandler *node;
 
     QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
-        if (!node->deleted && node->io_poll &&
+        if (!node->deleted && node->io_poll && !node->poll_idle &&
             aio_node_check(ctx, node->is_external) &&
             node->io_poll(node->opaque)) {
+            node->poll_idle_timeout = 0;
             progress = true;
         }
 
@@ -504,6 +528,47 @@ static bool run_poll_handlers_once(AioContext *ctx)
     return progress;
 }
 
+/* Stop busy polling the handlers that have not made progress for
+ * ctx->poll_idle_ns, so that an idle handler does not make polling
+ * the others more expensive.  They are monitored through their fd instead.
+ *
+ * Returns: true if progress was made, false otherwise
+ */
+static bool poll_set_idle_handlers(AioContext *ctx, int64_t now)
+{
+    bool progress = false;
+    AioHandler *node;
+
+    QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
+        if (node->deleted || !node->io_poll || node->poll_idle) {
+            continue;
+        }
+
+        if (node->poll_idle_timeout == 0) {
+            node->poll_idle_timeout = now + ctx->poll_idle_ns;
+            continue;
+        }
+        if (now < node->poll_idle_timeout) {
+            continue;
+        }
+
+        trace_poll_idle(ctx, node, node->pfd.fd);
+        node->poll_idle = true;
+
+        if (ctx->poll_started && node->io_poll_end) {
+            node->io_poll_end(node->opaque);
+
+            /* Poll one last time in case io_poll_end() raced with an event */
+            if (aio_node_check(ctx, node->is_external) &&
+                node->io_poll(node->opaque)) {
+                progress = true;
+            }
+        }
+    }
+
+    return progress;
+}
+
 /* run_poll_handlers:
  * @ctx: the AioContext
  * @max_ns: maximum time to poll for, in nanoseconds
@@ -520,7 +585,7 @@ static bool run_poll_handlers_once(AioContext *ctx)
 static bool run_poll_handlers(AioContext *ctx, int64_t max_ns)
 {
     bool progress;
-    int64_t end_time;
+    int64_t start_time, end_time, now;
 
     assert(ctx->notify_me);
     assert(qemu_lockcnt_count(&ctx->list_lock) > 0);
@@ -528,11 +593,22 @@ static bool run_poll_handlers(AioContext *ctx, int64_t max_ns)
 
     trace_run_poll_handlers_begin(ctx, max_ns);
 
-    end_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + max_ns;
+    start_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    end_time = start_time + max_ns;
 
     do {
         progress = run_poll_handlers_once(ctx);
-    } while (!progress && qemu_clock_get_ns(QEMU_CLOCK_REALTIME) < end_time);
+        now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    } while (!progress && now < end_time);
+
+    progress |= poll_set_idle_handlers(ctx, now);
+
+    if (progress) {
+        ctx->poll_hits++;
+    } else {
+        ctx->poll_misses++;
+    }
+    ctx->poll_busy_ns += now - start_time;
 
     trace_run_poll_handlers_end(ctx, progress);
 
@@ -701,6 +777,8 @@ bool aio_poll(AioContext *ctx, bool blocking)
 
 void aio_context_setup(AioContext *ctx)
 {
+    ctx->poll_idle_ns = POLL_IDLE_INTERVAL_NS;
+
 #ifdef CONFIG_EPOLL_CREATE1
     assert(!ctx->epollfd);
     ctx->epollfd = epoll_create1(EPOLL_CLOEXEC);
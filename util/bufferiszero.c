@@ -188,12 +188,48 @@ buffer_zero_avx2(const void *buf, size_t len)
 #pragma GCC pop_options
 #endif /* CONFIG_AVX2_OPT */
 
+#ifdef CONFIG_AVX512F_OPT
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#include <immintrin.h>
+
+/* Note that this function requires len >= 256.  */
+static bool
+buffer_zero_avx512(const void *buf, size_t len)
+{
+    /* Begin with an unaligned head of 64 bytes.  */
+    __m512i t = _mm512_loadu_si512(buf);
+    __m512i *p = (__m512i *)(((uintptr_t)buf + 5 * 64) & -64);
+    __m512i *e = (__m512i *)(((uintptr_t)buf + len) & -64);
+
+    /* Loop over 64-byte aligned blocks of 256.  */
+    while (likely(p <= e)) {
+        __builtin_prefetch(p);
+        if (unlikely(_mm512_test_epi64_mask(t, t))) {
+            return false;
+        }
+        t = p[-4] | p[-3] | p[-2] | p[-1];
+        p += 4;
+    }
+
+    /* Finish the last block of 256 unaligned.  */
+    t |= _mm512_loadu_si512(buf + len - 4 * 64);
+    t |= _mm512_loadu_si512(buf + len - 3 * 64);
+    t |= _mm512_loadu_si512(buf + len - 2 * 64);
+    t |= _mm512_loadu_si512(buf + len - 1 * 64);
+
+    return !_mm512_test_epi64_mask(t, t);
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX512F_OPT */
+
 /* Note that for test_buffer_is_zero_next_accel, the most preferred
  * ISA must have the least significant bit.
  */
-#define CACHE_AVX2    1
-#define CACHE_SSE4    2
-#define CACHE_SSE2    4
+#define CACHE_AVX512F 1
+#define CACHE_AVX2    2
+#define CACHE_SSE4    4
+#define CACHE_SSE2    8
 
 /* Make sure that these variables are appropriately initialized when
  * SSE2 is enabled on the compiler command-line, but the compiler is
@@ -212,10 +248,13 @@ buffer_zero_avx2(const void *buf, size_t len)
 
 static unsigned cpuid_cache = INIT_CACHE;
 static bool (*buffer_accel)(const void *, size_t) = INIT_ACCEL;
+static size_t length_to_accel = 64;
 
 static void init_accel(unsigned cache)
 {
     bool (*fn)(const void *, size_t) = buffer_zero_int;
+    size_t len = 64;
+
     if (cache & CACHE_SSE2) {
         fn = buffer_zero_sse2;
     }
@@ -226,8 +265,15 @@ static void init_accel(unsigned cache)
     if (cache & CACHE_AVX2) {
         fn = buffer_zero_avx2;
     }
+#endif
+#ifdef CONFIG_AVX512F_OPT
+    if (cache & CACHE_AVX512F) {
+        fn = buffer_zero_avx512;
+        len = 256;
+    }
 #endif
     buffer_accel = fn;
+    length_to_accel = len;
 }
 
 #ifdef CONFIG_AVX2_OPT
@@ -256,6 +302,12 @@ static void __attribute__((constructor)) init_cpuid_cache(void)
             if ((bv & 6) == 6 && (b & bit_AVX2)) {
                 cache |= CACHE_AVX2;
             }
+            /* 0xe6: the ZMM state (opmask, ZMM0-15 upper halves and
+             * ZMM16-31) must be enabled by the OS as well.
+             */
+            if ((bv & 0xe6) == 0xe6 && (b & bit_AVX512F)) {
+                cache |= CACHE_AVX512F;
+            }
         }
     }
     cpuid_cache = cache;
@@ -276,6 +328,59 @@ bool test_buffer_is_zero_next_accel(void)
     return true;
 }
 
+static bool select_accel_fn(const void *buf, size_t len)
+{
+    if (likely(len >= length_to_accel)) {
+        return buffer_accel(buf, len);
+    }
+    return buffer_zero_int(buf, len);
+}
+
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+
+/* Advanced SIMD is part of the aarch64 baseline, so there is nothing
+ * to detect at run time.  Note that this function requires len >= 64.
+ */
+static bool
+buffer_zero_neon(const void *buf, size_t len)
+{
+    uint64x2_t t = vld1q_u64(buf);
+    const uint64x2_t *p = (uint64x2_t *)(((uintptr_t)buf + 5 * 16) & -16);
+    const uint64x2_t *e = (uint64x2_t *)(((uintptr_t)buf + len) & -16);
+
+    /* Loop over 16-byte aligned blocks of 64.  */
+    while (likely(p <= e)) {
+        __builtin_prefetch(p);
+        if (unlikely(vmaxvq_u32(vreinterpretq_u32_u64(t)))) {
+            return false;
+        }
+        t = vorrq_u64(vorrq_u64(p[-4], p[-3]), vorrq_u64(p[-2], p[-1]));
+        p += 4;
+    }
+
+    /* Finish the aligned tail.  */
+    t = vorrq_u64(t, e[-3]);
+    t = vorrq_u64(t, e[-2]);
+    t = vorrq_u64(t, e[-1]);
+
+    /* Finish the unaligned tail.  */
+    t = vorrq_u64(t, vld1q_u64(buf + len - 16));
+
+    return vmaxvq_u32(vreinterpretq_u32_u64(t)) == 0;
+}
+
+static bool (*buffer_accel)(const void *, size_t) = buffer_zero_neon;
+
+bool test_buffer_is_zero_next_accel(void)
+{
+    if (buffer_accel == buffer_zero_int) {
+        return false;
+    }
+    buffer_accel = buffer_zero_int;
+    return true;
+}
+
 static bool select_accel_fn(const void *buf, size_t len)
 {
     if (likely(len >= 64)) {
@@ -292,6 +397,16 @@ bool test_buffer_is_zero_next_accel(void)
 }
 #endif
 
+/*
+ * Sample the first, middle and last bytes before scanning.  Buffers that
+ * are mostly non-zero fail here without streaming through all of @buf;
+ * for the others the three lines would be read by the scan anyway.
+ */
+static inline bool buffer_is_zero_sample3(const char *buf, size_t len)
+{
+    return (buf[0] | buf[len / 2] | buf[len - 1]) == 0;
+}
+
 /*
  * Checks if a buffer is all zeroes
  */
@@ -301,10 +416,42 @@ bool buffer_is_zero(const void *buf, size_t len)
         return true;
     }
 
-    /* Fetch the beginning of the buffer while we select the accelerator.  */
-    __builtin_prefetch(buf);
+    if (!buffer_is_zero_sample3(buf, len)) {
+        return false;
+    }
 
     /* Use an optimized zero check if possible.  Note that this also
        includes a check for an unrolled loop over 64-bit integers.  */
     return select_accel_fn(buf, len);
 }
+
+/*
+ * Checks @n consecutive chunks of @chunk bytes starting at @buf, and
+ * returns how many of them, counting from the first, are all zeroes
+ * if the first one is, or contain a non-zero byte if the first one does.
+ * *@is_zero is set to whether the first chunk is all zeroes.
+ */
+size_t buffer_is_zero_run(const void *buf, size_t chunk, size_t n,
+                          bool *is_zero)
+{
+    const char *p = buf;
+    bool first;
+    size_t i;
+
+    assert(chunk > 0 && n > 0);
+
+    first = buffer_is_zero(p, chunk);
+    for (i = 1; i < n; i++) {
+        p += chunk;
+        __builtin_prefetch(p + chunk);
+        if (buffer_is_zero_sample3(p, chunk)) {
+            if (first != select_accel_fn(p, chunk)) {
+                break;
+            }
+        } else if (first) {
+            break;
+        }
+    }
+    *is_zero = first;
+    return i;
+}
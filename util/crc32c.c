@@ -28,6 +28,7 @@
 #include "qemu/osdep.h"
 #include "qemu-common.h"
 #include "qemu/crc32c.h"
+#include "qemu/bswap.h"
 
 /*
  * This is the CRC-32C table
@@ -105,12 +106,120 @@ static const uint32_t crc32c_table[256] = {
     0xBE2DA0A5L, 0x4C4623A6L, 0x5F16D052L, 0xAD7D5351L
 };
 
-
-uint32_t crc32c(uint32_t crc, const uint8_t *data, unsigned int length)
+static uint32_t crc32c_int(uint32_t crc, const uint8_t *data,
+                           unsigned int length)
 {
     while (length--) {
         crc = crc32c_table[(crc ^ *data++) & 0xFFL] ^ (crc >> 8);
     }
-    return crc^0xffffffff;
+    return crc;
+}
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+/* The CRC extension is part of the compile-time baseline, so there is
+ * nothing to detect at run time; the table only handles the tail.
+ */
+#include <arm_acle.h>
+
+static uint32_t crc32c_armv8(uint32_t crc, const uint8_t *data,
+                             unsigned int length)
+{
+    for (; length >= 8; length -= 8, data += 8) {
+        crc = __crc32cd(crc, ldq_le_p(data));
+    }
+    return crc32c_int(crc, data, length);
+}
+#define crc32c_base  crc32c_armv8
+#else
+#define crc32c_base  crc32c_int
+#endif
+
+#ifdef CONFIG_SSE42_OPT
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+#include <nmmintrin.h>
+
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data,
+                             unsigned int length)
+{
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+
+    for (; length >= 8; length -= 8, data += 8) {
+        crc64 = _mm_crc32_u64(crc64, ldq_le_p(data));
+    }
+    crc = crc64;
+#endif
+    for (; length >= 4; length -= 4, data += 4) {
+        crc = _mm_crc32_u32(crc, ldl_le_p(data));
+    }
+    while (length--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#pragma GCC pop_options
+
+/* Note that for test_crc32c_next_accel, the most preferred
+ * ISA must have the least significant bit.
+ */
+#define CACHE_SSE42   1
+
+static unsigned cpuid_cache;
+static uint32_t (*crc32c_accel)(uint32_t, const uint8_t *, unsigned int) =
+    crc32c_base;
+
+static void init_accel(unsigned cache)
+{
+    uint32_t (*fn)(uint32_t, const uint8_t *, unsigned int) = crc32c_base;
+
+    if (cache & CACHE_SSE42) {
+        fn = crc32c_sse42;
+    }
+    crc32c_accel = fn;
+}
+
+#include "qemu/cpuid.h"
+
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 1) {
+        __cpuid(1, a, b, c, d);
+        if (c & bit_SSE4_2) {
+            cache |= CACHE_SSE42;
+        }
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+
+bool test_crc32c_next_accel(void)
+{
+    /* If no bits set, we just tested crc32c_base, and there
+       are no more acceleration options to test.  */
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+
+#else
+#define crc32c_accel  crc32c_base
+bool test_crc32c_next_accel(void)
+{
+    return false;
+}
+#endif /* CONFIG_SSE42_OPT */
+
+uint32_t crc32c(uint32_t crc, const uint8_t *data, unsigned int length)
+{
+    return crc32c_accel(crc, data, length) ^ 0xffffffff;
 }
 
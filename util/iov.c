@@ -22,11 +22,24 @@
 #include "qemu/sockets.h"
 #include "qemu/cutils.h"
 
+/* Does the range [offset, offset + bytes) lie within the first element?  */
+static inline bool iov_in_first(const struct iovec *iov, unsigned int iov_cnt,
+                                size_t offset, size_t bytes)
+{
+    return iov_cnt && offset <= iov[0].iov_len &&
+           bytes <= iov[0].iov_len - offset;
+}
+
 size_t iov_from_buf_full(const struct iovec *iov, unsigned int iov_cnt,
                          size_t offset, const void *buf, size_t bytes)
 {
     size_t done;
     unsigned int i;
+
+    if (likely(iov_in_first(iov, iov_cnt, offset, bytes))) {
+        memcpy(iov[0].iov_base + offset, buf, bytes);
+        return bytes;
+    }
     for (i = 0, done = 0; (offset || done < bytes) && i < iov_cnt; i++) {
         if (offset < iov[i].iov_len) {
             size_t len = MIN(iov[i].iov_len - offset, bytes - done);
@@ -46,6 +59,11 @@ size_t iov_to_buf_full(const struct iovec *iov, const unsigned int iov_cnt,
 {
     size_t done;
     unsigned int i;
+
+    if (likely(iov_in_first(iov, iov_cnt, offset, bytes))) {
+        memcpy(buf, iov[0].iov_base + offset, bytes);
+        return bytes;
+    }
     for (i = 0, done = 0; (offset || done < bytes) && i < iov_cnt; i++) {
         if (offset < iov[i].iov_len) {
             size_t len = MIN(iov[i].iov_len - offset, bytes - done);
@@ -65,6 +83,11 @@ size_t iov_memset(const struct iovec *iov, const unsigned int iov_cnt,
 {
     size_t done;
     unsigned int i;
+
+    if (likely(iov_in_first(iov, iov_cnt, offset, bytes))) {
+        memset(iov[0].iov_base + offset, fillc, bytes);
+        return bytes;
+    }
     for (i = 0, done = 0; (offset || done < bytes) && i < iov_cnt; i++) {
         if (offset < iov[i].iov_len) {
             size_t len = MIN(iov[i].iov_len - offset, bytes - done);
@@ -247,6 +270,13 @@ unsigned iov_copy(struct iovec *dst_iov, unsigned int dst_iov_cnt,
 {
     size_t len;
     unsigned int i, j;
+
+    if (likely(bytes && dst_iov_cnt &&
+               iov_in_first(iov, iov_cnt, offset, bytes))) {
+        dst_iov[0].iov_base = iov[0].iov_base + offset;
+        dst_iov[0].iov_len = bytes;
+        return 1;
+    }
     for (i = 0, j = 0;
          i < iov_cnt && j < dst_iov_cnt && (offset || bytes); i++) {
         if (offset >= iov[i].iov_len) {
@@ -22,7 +22,7 @@
 #include "block/aio.h"
 
 enum {
-    POOL_BATCH_SIZE = 64,
+    POOL_DEFAULT_BATCH_SIZE = 64,
 };
 
 /** Free list to speed up creation */
@@ -31,6 +31,16 @@ static unsigned int release_pool_size;
 static __thread QSLIST_HEAD(, Coroutine) alloc_pool = QSLIST_HEAD_INITIALIZER(pool);
 static __thread unsigned int alloc_pool_size;
 static __thread Notifier coroutine_pool_cleanup_notifier;
+static unsigned int pool_batch_size = POOL_DEFAULT_BATCH_SIZE;
+
+/* Only updated on the slow paths, so that the fast path stays thread-local */
+static CoroutinePoolStats pool_stats;
+
+static void coroutine_free_stack(Coroutine *co)
+{
+    atomic_inc(&pool_stats.freed);
+    qemu_coroutine_delete(co);
+}
 
 static void coroutine_pool_cleanup(Notifier *n, void *value)
 {
@@ -39,7 +49,7 @@ static void coroutine_pool_cleanup(Notifier *n, void *value)
 
     QSLIST_FOREACH_SAFE(co, &alloc_pool, pool_next, tmp) {
         QSLIST_REMOVE_HEAD(&alloc_pool, pool_next);
-        qemu_coroutine_delete(co);
+        coroutine_free_stack(co);
     }
 }
 
@@ -50,7 +60,7 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
     if (CONFIG_COROUTINE_POOL) {
         co = QSLIST_FIRST(&alloc_pool);
         if (!co) {
-            if (release_pool_size > POOL_BATCH_SIZE) {
+            if (release_pool_size > atomic_read(&pool_batch_size)) {
                 /* Slow path; a good place to register the destructor, too.  */
                 if (!coroutine_pool_cleanup_notifier.notify) {
                     coroutine_pool_cleanup_notifier.notify = coroutine_pool_cleanup;
@@ -64,6 +74,7 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
                 alloc_pool_size = atomic_xchg(&release_pool_size, 0);
                 QSLIST_MOVE_ATOMIC(&alloc_pool, &release_pool);
                 co = QSLIST_FIRST(&alloc_pool);
+                atomic_inc(&pool_stats.refills);
             }
         }
         if (co) {
@@ -73,6 +84,7 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
     }
 
     if (!co) {
+        atomic_inc(&pool_stats.allocated);
         co = qemu_coroutine_new();
     }
 
@@ -87,19 +99,39 @@ static void coroutine_delete(Coroutine *co)
     co->caller = NULL;
 
     if (CONFIG_COROUTINE_POOL) {
-        if (release_pool_size < POOL_BATCH_SIZE * 2) {
+        unsigned int batch_size = atomic_read(&pool_batch_size);
+
+        if (release_pool_size < batch_size * 2) {
             QSLIST_INSERT_HEAD_ATOMIC(&release_pool, co, pool_next);
             atomic_inc(&release_pool_size);
             return;
         }
-        if (alloc_pool_size < POOL_BATCH_SIZE) {
+        if (alloc_pool_size < batch_size) {
             QSLIST_INSERT_HEAD(&alloc_pool, co, pool_next);
             alloc_pool_size++;
             return;
         }
     }
 
-    qemu_coroutine_delete(co);
+    coroutine_free_stack(co);
+}
+
+void qemu_coroutine_increase_pool_batch_size(unsigned int additional_size)
+{
+    atomic_add(&pool_batch_size, additional_size);
+}
+
+void qemu_coroutine_decrease_pool_batch_size(unsigned int removed_size)
+{
+    atomic_sub(&pool_batch_size, removed_size);
+}
+
+void qemu_coroutine_get_pool_stats(CoroutinePoolStats *stats)
+{
+    stats->allocated = atomic_read(&pool_stats.allocated);
+    stats->freed = atomic_read(&pool_stats.freed);
+    stats->refills = atomic_read(&pool_stats.refills);
+    stats->batch_size = atomic_read(&pool_batch_size);
 }
 
 void qemu_aio_coroutine_enter(AioContext *ctx, Coroutine *co)
@@ -22,8 +22,8 @@
  * - Writes (i.e. insertions/removals) can be concurrent with writes to
  *   different buckets; writes to the same bucket are serialized through a lock.
  * - Optional auto-resizing: the hash table resizes up if the load surpasses
- *   a certain threshold. Resizing is done concurrently with readers; writes
- *   are serialized with the resize operation.
+ *   a certain threshold. Resizing is done concurrently with readers and, for
+ *   auto-resizes, incrementally with respect to writers (see below).
  *
  * The key structure is the bucket, which is cacheline-sized. Buckets
  * contain a few hash values and pointers; the u32 hash values are stored in
@@ -43,10 +43,26 @@
  * just-removed entry. This makes lookups slightly faster, since the moment an
  * invalid entry is found, the (failed) lookup is over.
  *
- * Resizing is done by taking all bucket spinlocks (so that no other writers can
- * race with us) and then copying all entries into a new hash map. Then, the
- * ht->map pointer is set, and the old map is freed once no RCU readers can see
- * it anymore.
+ * Explicit resizes (and resets) are done by taking all bucket spinlocks (so
+ * that no other writers can race with us) and then copying all entries into a
+ * new hash map. Then, the ht->map pointer is set, and the old map is freed once
+ * no RCU readers can see it anymore.
+ *
+ * Auto-resizes do not stop the world: a map twice as large is published right
+ * away, with map->old pointing to the previous map, and the old head buckets
+ * are then migrated a batch at a time by the writers that follow. Migrating a
+ * bucket copies its entries into the new map (the old bucket is left intact)
+ * and then sets the bucket's bit in map->migrated. While map->old is set:
+ * - New entries are only ever inserted into the new map.
+ * - Lookups first check the old bucket unless it has been migrated, and then
+ *   the new one.
+ * - Writers also lock the old bucket if it has not been migrated, so that
+ *   they can check it for duplicates (insert) or remove from it (remove).
+ *   The old bucket's lock is always acquired before the new bucket's.
+ * Once all buckets are migrated, map->old is cleared and the old map is freed
+ * after an RCU grace period. Operations that need a consistent view of the
+ * whole table (explicit resizes, resets, iterators and statistics) complete
+ * any ongoing migration first.
  *
  * Writers check for concurrent resizes by comparing ht->map before and after
  * acquiring their bucket lock. If they don't match, a resize has occured
@@ -68,6 +84,7 @@
 #include "qemu/osdep.h"
 #include "qemu/qht.h"
 #include "qemu/atomic.h"
+#include "qemu/bitmap.h"
 #include "qemu/rcu.h"
 
 //#define QHT_DEBUG
@@ -119,6 +136,10 @@ QEMU_BUILD_BUG_ON(sizeof(struct qht_bucket) > QHT_BUCKET_ALIGN);
  * @n_added_buckets: number of added (i.e. "non-head") buckets
  * @n_added_buckets_threshold: threshold to trigger an upward resize once the
  *                             number of added buckets surpasses it.
+ * @old: map whose entries are being migrated into this one, or NULL.
+ * @migrated: bitmap of the head buckets in @old that have been migrated.
+ * @migrate_pos: index of the next head bucket in @old to be migrated.
+ *               Protected by ht->lock.
  *
  * Buckets are tracked in what we call a "map", i.e. this structure.
  */
@@ -128,14 +149,26 @@ struct qht_map {
     size_t n_buckets;
     size_t n_added_buckets;
     size_t n_added_buckets_threshold;
+    struct qht_map *old;
+    unsigned long *migrated;
+    size_t migrate_pos;
 };
 
 /* trigger a resize when n_added_buckets > n_buckets / div */
 #define QHT_NR_ADDED_BUCKETS_THRESHOLD_DIV 8
 
+/*
+ * Migrate at least this many head buckets per write, or 1/64th of the old
+ * map, whichever is larger; the latter bounds the number of writes that a
+ * migration takes to complete.
+ */
+#define QHT_MIGRATE_BATCH_MIN 16
+#define QHT_MIGRATE_BATCH_DIV 64
+
 static void qht_do_resize_reset(struct qht *ht, struct qht_map *new,
                                 bool reset);
 static void qht_grow_maybe(struct qht *ht);
+static void qht_migrate_all__locked(struct qht *ht);
 
 #ifdef QHT_DEBUG
 
@@ -247,14 +280,18 @@ void qht_map_lock_buckets__no_stale(struct qht *ht, struct qht_map **pmap)
 
     map = atomic_rcu_read(&ht->map);
     qht_map_lock_buckets(map);
-    if (likely(!qht_map_is_stale__locked(ht, map))) {
+    if (likely(!qht_map_is_stale__locked(ht, map) && !map->old)) {
         *pmap = map;
         return;
     }
     qht_map_unlock_buckets(map);
 
-    /* we raced with a resize; acquire ht->lock to see the updated ht->map */
+    /*
+     * We raced with a resize, or there is a migration in progress; acquire
+     * ht->lock to see the updated ht->map and to complete the migration.
+     */
     qemu_mutex_lock(&ht->lock);
+    qht_migrate_all__locked(ht);
     map = ht->map;
     qht_map_lock_buckets(map);
     qemu_mutex_unlock(&ht->lock);
@@ -262,38 +299,92 @@ void qht_map_lock_buckets__no_stale(struct qht *ht, struct qht_map **pmap)
     return;
 }
 
+/*
+ * If @map is being migrated and the old head bucket for @hash has not been
+ * migrated yet, lock that bucket and return it. Otherwise return NULL.
+ *
+ * The old bucket cannot be migrated while we hold its lock, which in turn
+ * keeps the old map alive until the lock is released.
+ */
+static inline
+struct qht_bucket *qht_map_lock_old_bucket(struct qht_map *map, uint32_t hash)
+{
+    struct qht_bucket *b = NULL;
+    struct qht_map *old;
+    size_t idx;
+
+    if (likely(atomic_read(&map->old) == NULL)) {
+        return NULL;
+    }
+
+    rcu_read_lock();
+    old = atomic_rcu_read(&map->old);
+    if (old) {
+        idx = hash & (old->n_buckets - 1);
+        if (!test_bit(idx, map->migrated)) {
+            b = &old->buckets[idx];
+            qemu_spin_lock(&b->lock);
+            /* the bucket might have been migrated while we waited */
+            if (unlikely(test_bit(idx, map->migrated))) {
+                qemu_spin_unlock(&b->lock);
+                b = NULL;
+            }
+        }
+    }
+    rcu_read_unlock();
+    return b;
+}
+
+static inline void qht_bucket_unlock(struct qht_bucket *b,
+                                     struct qht_bucket *old_b)
+{
+    qemu_spin_unlock(&b->lock);
+    if (old_b) {
+        qemu_spin_unlock(&old_b->lock);
+    }
+}
+
 /*
  * Get a head bucket and lock it, making sure its parent map is not stale.
  * @pmap is filled with a pointer to the bucket's parent map.
+ * If the parent map is being migrated and the corresponding head bucket in
+ * the old map has not been migrated yet, that bucket is locked too and
+ * returned in @pold_b; otherwise @pold_b is set to NULL.
  *
- * Unlock with qemu_spin_unlock(&b->lock).
+ * Unlock with qht_bucket_unlock(b, *pold_b).
  *
  * Note: callers cannot have ht->lock held.
  */
 static inline
 struct qht_bucket *qht_bucket_lock__no_stale(struct qht *ht, uint32_t hash,
-                                             struct qht_map **pmap)
+                                             struct qht_map **pmap,
+                                             struct qht_bucket **pold_b)
 {
     struct qht_bucket *b;
+    struct qht_bucket *old_b;
     struct qht_map *map;
 
     map = atomic_rcu_read(&ht->map);
+    old_b = qht_map_lock_old_bucket(map, hash);
     b = qht_map_to_bucket(map, hash);
 
     qemu_spin_lock(&b->lock);
     if (likely(!qht_map_is_stale__locked(ht, map))) {
         *pmap = map;
+        *pold_b = old_b;
         return b;
     }
-    qemu_spin_unlock(&b->lock);
+    qht_bucket_unlock(b, old_b);
 
     /* we raced with a resize; acquire ht->lock to see the updated ht->map */
     qemu_mutex_lock(&ht->lock);
     map = ht->map;
+    old_b = qht_map_lock_old_bucket(map, hash);
     b = qht_map_to_bucket(map, hash);
     qemu_spin_lock(&b->lock);
     qemu_mutex_unlock(&ht->lock);
     *pmap = map;
+    *pold_b = old_b;
     return b;
 }
 
@@ -323,6 +414,7 @@ static void qht_map_destroy(struct qht_map *map)
         qht_chain_destroy(&map->buckets[i]);
     }
     qemu_vfree(map->buckets);
+    g_free(map->migrated);
     g_free(map);
 }
 
@@ -333,6 +425,9 @@ static struct qht_map *qht_map_create(size_t n_buckets)
 
     map = g_malloc(sizeof(*map));
     map->n_buckets = n_buckets;
+    map->old = NULL;
+    map->migrated = NULL;
+    map->migrate_pos = 0;
 
     map->n_added_buckets = 0;
     map->n_added_buckets_threshold = n_buckets /
@@ -365,6 +460,9 @@ void qht_init(struct qht *ht, size_t n_elems, unsigned int mode)
 /* call only when there are no readers/writers left */
 void qht_destroy(struct qht *ht)
 {
+    if (ht->map->old) {
+        qht_map_destroy(ht->map->old);
+    }
     qht_map_destroy(ht->map);
     memset(ht, 0, sizeof(*ht));
 }
@@ -479,6 +577,36 @@ void *qht_lookup__slowpath(struct qht_bucket *b, qht_lookup_func_t func,
     return ret;
 }
 
+/*
+ * Entries that were in the old map when the migration started stay in their
+ * old head bucket until it is migrated, whereas new entries only go to the
+ * new map. Migrated buckets are not cleared, so it is safe to look in the
+ * old bucket even if it is migrated while we traverse it.
+ */
+static __attribute__((noinline))
+void *qht_lookup__migrating(struct qht_map *map, qht_lookup_func_t func,
+                            const void *userp, uint32_t hash)
+{
+    struct qht_map *old = atomic_rcu_read(&map->old);
+
+    if (old) {
+        size_t idx = hash & (old->n_buckets - 1);
+
+        if (!test_bit(idx, map->migrated)) {
+            void *ret;
+
+            ret = qht_lookup__slowpath(&old->buckets[idx], func, userp, hash);
+            if (ret) {
+                return ret;
+            }
+        }
+        /* pairs with smp_wmb() in qht_migrate__locked() */
+        smp_rmb();
+    }
+    return qht_lookup__slowpath(qht_map_to_bucket(map, hash), func, userp,
+                                hash);
+}
+
 void *qht_lookup(struct qht *ht, qht_lookup_func_t func, const void *userp,
                  uint32_t hash)
 {
@@ -488,6 +616,9 @@ void *qht_lookup(struct qht *ht, qht_lookup_func_t func, const void *userp,
     void *ret;
 
     map = atomic_rcu_read(&ht->map);
+    if (unlikely(atomic_rcu_read(&map->old))) {
+        return qht_lookup__migrating(map, func, userp, hash);
+    }
     b = qht_map_to_bucket(map, hash);
 
     version = seqlock_read_begin(&b->sequence);
@@ -548,23 +679,127 @@ static bool qht_insert__locked(struct qht *ht, struct qht_map *map,
     return true;
 }
 
+/* call with head->lock held */
+static bool qht_bucket_has__locked(struct qht_bucket *head, const void *p)
+{
+    struct qht_bucket *b = head;
+    int i;
+
+    do {
+        for (i = 0; i < QHT_BUCKET_ENTRIES; i++) {
+            if (b->pointers[i] == NULL) {
+                return false;
+            }
+            if (b->pointers[i] == p) {
+                return true;
+            }
+        }
+        b = b->next;
+    } while (b);
+    return false;
+}
+
+/*
+ * Copy the entries of @old_b, which belongs to map->old, into @map.
+ * Call with old_b->lock held.
+ */
+static void qht_bucket_migrate__locked(struct qht *ht, struct qht_map *map,
+                                       struct qht_bucket *old_b)
+{
+    struct qht_bucket *b = old_b;
+    int i;
+
+    do {
+        for (i = 0; i < QHT_BUCKET_ENTRIES; i++) {
+            struct qht_bucket *head;
+            void *p = b->pointers[i];
+
+            if (p == NULL) {
+                return;
+            }
+            head = qht_map_to_bucket(map, b->hashes[i]);
+            qemu_spin_lock(&head->lock);
+            qht_insert__locked(ht, map, head, p, b->hashes[i], NULL);
+            qht_bucket_debug__locked(head);
+            qemu_spin_unlock(&head->lock);
+        }
+        b = b->next;
+    } while (b);
+}
+
+/*
+ * Migrate up to @n head buckets from map->old into ht->map, freeing the old
+ * map once all of its buckets have been migrated.
+ * Call with ht->lock held.
+ */
+static void qht_migrate__locked(struct qht *ht, size_t n)
+{
+    struct qht_map *map = ht->map;
+    struct qht_map *old = map->old;
+    size_t end;
+    size_t i;
+
+    if (old == NULL) {
+        return;
+    }
+    end = MIN(map->migrate_pos + n, old->n_buckets);
+    for (i = map->migrate_pos; i < end; i++) {
+        struct qht_bucket *old_b = &old->buckets[i];
+
+        qemu_spin_lock(&old_b->lock);
+        qht_bucket_migrate__locked(ht, map, old_b);
+        /* make the copies visible before readers skip the old bucket */
+        smp_wmb();
+        set_bit_atomic(i, map->migrated);
+        qemu_spin_unlock(&old_b->lock);
+    }
+    map->migrate_pos = end;
+
+    if (end == old->n_buckets) {
+        atomic_rcu_set(&map->old, NULL);
+        call_rcu(old, qht_map_destroy, rcu);
+    }
+}
+
+static void qht_migrate_all__locked(struct qht *ht)
+{
+    qht_migrate__locked(ht, SIZE_MAX);
+}
+
+/*
+ * Publish a map twice as large as the current one and start migrating
+ * entries into it. Call with ht->lock held.
+ */
+static void qht_grow_start__locked(struct qht *ht)
+{
+    struct qht_map *old = ht->map;
+    struct qht_map *new = qht_map_create(old->n_buckets * 2);
+
+    new->migrated = bitmap_new(old->n_buckets);
+    new->old = old;
+    atomic_rcu_set(&ht->map, new);
+}
+
 static __attribute__((noinline)) void qht_grow_maybe(struct qht *ht)
 {
     struct qht_map *map;
 
     /*
-     * If the lock is taken it probably means there's an ongoing resize,
-     * so bail out.
+     * If the lock is taken it probably means there's an ongoing resize
+     * or migration step, so bail out.
      */
     if (qemu_mutex_trylock(&ht->lock)) {
         return;
     }
     map = ht->map;
-    /* another thread might have just performed the resize we were after */
-    if (qht_map_needs_resize(map)) {
-        struct qht_map *new = qht_map_create(map->n_buckets * 2);
-
-        qht_do_resize(ht, new);
+    if (map->old) {
+        size_t n = MAX(QHT_MIGRATE_BATCH_MIN,
+                       map->old->n_buckets / QHT_MIGRATE_BATCH_DIV);
+
+        qht_migrate__locked(ht, n);
+    } else if (qht_map_needs_resize(map)) {
+        /* another thread might have just started the resize we were after */
+        qht_grow_start__locked(ht);
     }
     qemu_mutex_unlock(&ht->lock);
 }
@@ -572,6 +807,7 @@ static __attribute__((noinline)) void qht_grow_maybe(struct qht *ht)
 bool qht_insert(struct qht *ht, void *p, uint32_t hash)
 {
     struct qht_bucket *b;
+    struct qht_bucket *old_b;
     struct qht_map *map;
     bool needs_resize = false;
     bool ret;
@@ -579,10 +815,16 @@ bool qht_insert(struct qht *ht, void *p, uint32_t hash)
     /* NULL pointers are not supported */
     qht_debug_assert(p);
 
-    b = qht_bucket_lock__no_stale(ht, hash, &map);
-    ret = qht_insert__locked(ht, map, b, p, hash, &needs_resize);
+    b = qht_bucket_lock__no_stale(ht, hash, &map, &old_b);
+    if (unlikely(old_b) && qht_bucket_has__locked(old_b, p)) {
+        ret = false;
+    } else {
+        ret = qht_insert__locked(ht, map, b, p, hash, &needs_resize);
+    }
+    /* keep the migration going; @map cannot be freed while we hold @b */
+    needs_resize |= !!atomic_read(&map->old);
     qht_bucket_debug__locked(b);
-    qemu_spin_unlock(&b->lock);
+    qht_bucket_unlock(b, old_b);
 
     if (unlikely(needs_resize) && ht->mode & QHT_MODE_AUTO_RESIZE) {
         qht_grow_maybe(ht);
@@ -679,16 +921,25 @@ bool qht_remove__locked(struct qht_map *map, struct qht_bucket *head,
 bool qht_remove(struct qht *ht, const void *p, uint32_t hash)
 {
     struct qht_bucket *b;
+    struct qht_bucket *old_b;
     struct qht_map *map;
+    bool migrating;
     bool ret;
 
     /* NULL pointers are not supported */
     qht_debug_assert(p);
 
-    b = qht_bucket_lock__no_stale(ht, hash, &map);
-    ret = qht_remove__locked(map, b, p, hash);
+    b = qht_bucket_lock__no_stale(ht, hash, &map, &old_b);
+    /* an entry lives in at most one of the two buckets */
+    ret = (old_b && qht_remove__locked(map->old, old_b, p, hash)) ||
+          qht_remove__locked(map, b, p, hash);
+    migrating = !!atomic_read(&map->old);
     qht_bucket_debug__locked(b);
-    qemu_spin_unlock(&b->lock);
+    qht_bucket_unlock(b, old_b);
+
+    if (unlikely(migrating)) {
+        qht_grow_maybe(ht);
+    }
     return ret;
 }
 
@@ -723,8 +974,7 @@ void qht_iter(struct qht *ht, qht_iter_func_t func, void *userp)
 {
     struct qht_map *map;
 
-    map = atomic_rcu_read(&ht->map);
-    qht_map_lock_buckets(map);
+    qht_map_lock_buckets__no_stale(ht, &map);
     /* Note: ht here is merely for carrying ht->mode; ht->map won't be read */
     qht_map_iter__all_locked(ht, map, func, userp);
     qht_map_unlock_buckets(map);
@@ -747,6 +997,7 @@ static void qht_do_resize_reset(struct qht *ht, struct qht_map *new, bool reset)
 {
     struct qht_map *old;
 
+    qht_migrate_all__locked(ht);
     old = ht->map;
     qht_map_lock_buckets(old);
 
@@ -803,6 +1054,13 @@ void qht_statistics_init(struct qht *ht, struct qht_stats *stats)
         stats->head_buckets = 0;
         return;
     }
+    /* entries would be counted twice while a migration is in progress */
+    if (unlikely(atomic_read(&map->old))) {
+        qemu_mutex_lock(&ht->lock);
+        qht_migrate_all__locked(ht);
+        qemu_mutex_unlock(&ht->lock);
+        map = atomic_rcu_read(&ht->map);
+    }
     stats->head_buckets = map->n_buckets;
 
     for (i = 0; i < map->n_buckets; i++) {
@@ -32,6 +32,9 @@
 #include "qemu/atomic.h"
 #include "qemu/thread.h"
 #include "qemu/main-loop.h"
+#include "qemu/stats64.h"
+#include "qemu/timer.h"
+#include "trace.h"
 
 /*
  * Global grace period counter.  Bit 0 is always one in rcu_gp_ctr.
@@ -46,6 +49,11 @@ QemuEvent rcu_gp_event;
 static QemuMutex rcu_registry_lock;
 static QemuMutex rcu_sync_lock;
 
+static Stat64 rcu_gp_count;
+static Stat64 rcu_gp_ns;
+static Stat64 rcu_gp_max_ns;
+static Stat64 rcu_cb_count;
+
 /*
  * Check whether a quiescent state was crossed between the beginning of
  * update_counter_and_wait and now.
@@ -89,10 +97,11 @@ static void wait_for_readers(void)
             atomic_set(&index->waiting, true);
         }
 
-        /* Here, order the stores to index->waiting before the
-         * loads of index->ctr.
+        /* Here, order the stores to index->waiting before the loads of
+         * index->ctr.  Pairs with smp_mb_placeholder() in rcu_read_unlock(),
+         * ensuring that the loads of index->ctr are sequentially consistent.
          */
-        smp_mb();
+        smp_mb_global();
 
         QLIST_FOREACH_SAFE(index, &registry, node, tmp) {
             if (!rcu_gp_ongoing(&index->ctr)) {
@@ -138,9 +147,18 @@ static void wait_for_readers(void)
 
 void synchronize_rcu(void)
 {
+    int64_t start, ns;
+
     qemu_mutex_lock(&rcu_sync_lock);
+
+    /* Write RCU-protected pointers before reading p_rcu_reader->ctr.
+     * Pairs with smp_mb_placeholder() in rcu_read_lock().
+     */
+    smp_mb_global();
+
     qemu_mutex_lock(&rcu_registry_lock);
 
+    start = get_clock();
     if (!QLIST_EMPTY(&registry)) {
         /* In either case, the atomic_mb_set below blocks stores that free
          * old RCU-protected pointers.
@@ -161,9 +179,15 @@ void synchronize_rcu(void)
 
         wait_for_readers();
     }
+    ns = get_clock() - start;
 
     qemu_mutex_unlock(&rcu_registry_lock);
     qemu_mutex_unlock(&rcu_sync_lock);
+
+    stat64_add(&rcu_gp_count, 1);
+    stat64_add(&rcu_gp_ns, ns);
+    stat64_max(&rcu_gp_max_ns, ns);
+    trace_synchronize_rcu(ns);
 }
 
 
@@ -254,6 +278,8 @@ static void *call_rcu_thread(void *opaque)
 
         atomic_sub(&rcu_call_count, n);
         synchronize_rcu();
+        trace_call_rcu_thread_batch(n, atomic_read(&rcu_call_count));
+        stat64_add(&rcu_cb_count, n);
         qemu_mutex_lock_iothread();
         while (n > 0) {
             node = try_dequeue();
@@ -284,6 +310,15 @@ void call_rcu1(struct rcu_head *node, void (*func)(struct rcu_head *node))
     qemu_event_set(&rcu_call_ready_event);
 }
 
+void rcu_get_stats(RCUStats *stats)
+{
+    stats->grace_periods = stat64_get(&rcu_gp_count);
+    stats->grace_period_ns = stat64_get(&rcu_gp_ns);
+    stats->max_grace_period_ns = stat64_get(&rcu_gp_max_ns);
+    stats->callbacks = stat64_get(&rcu_cb_count);
+    stats->pending_callbacks = atomic_read(&rcu_call_count);
+}
+
 void rcu_register_thread(void)
 {
     assert(rcu_reader.ctr == 0);
@@ -364,6 +399,7 @@ static void rcu_init_child(void)
 
 static void __attribute__((__constructor__)) rcu_init(void)
 {
+    smp_mb_global_init();
 #ifdef CONFIG_POSIX
     pthread_atfork(rcu_init_lock, rcu_init_unlock, rcu_init_child);
 #endif
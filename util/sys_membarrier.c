@@ -0,0 +1,41 @@
+/*
+ * Process-global memory barriers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/sys_membarrier.h"
+#include "qemu/error-report.h"
+
+#include <linux/membarrier.h>
+
+static int membarrier(int cmd, int flags)
+{
+    return syscall(__NR_membarrier, cmd, flags);
+}
+
+void smp_mb_global(void)
+{
+    /*
+     * Private expedited barriers interrupt only the CPUs that are running
+     * one of our threads, and return as soon as they have all executed a
+     * memory barrier.
+     */
+    membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+}
+
+void smp_mb_global_init(void)
+{
+    int ret = membarrier(MEMBARRIER_CMD_QUERY, 0);
+
+    if (ret > 0 && (ret & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+        membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0) {
+        return;
+    }
+
+    error_report("This QEMU binary requires the membarrier system call.");
+    error_report("Please upgrade your system to Linux 4.14 or newer.");
+    exit(1);
+}
@@ -26,6 +26,7 @@
 static void do_spawn_thread(ThreadPool *pool);
 
 typedef struct ThreadPoolElement ThreadPoolElement;
+typedef struct ThreadPoolQueue ThreadPoolQueue;
 
 enum ThreadState {
     THREAD_QUEUED,
@@ -36,71 +37,296 @@ enum ThreadState {
 struct ThreadPoolElement {
     BlockAIOCB common;
     ThreadPool *pool;
+    ThreadPoolQueue *queue;
     ThreadPoolFunc *func;
     void *arg;
 
-    /* Moving state out of THREAD_QUEUED is protected by lock.  After
+    /* Moving state out of THREAD_QUEUED is protected by queue->lock.  After
      * that, only the worker thread can write to it.  Reads and writes
      * of state and ret are ordered with memory barriers.
      */
     enum ThreadState state;
     int ret;
 
-    /* Access to this list is protected by lock.  */
+    /* Access to this list is protected by queue->lock.  */
     QTAILQ_ENTRY(ThreadPoolElement) reqs;
 
     /* Access to this list is protected by the global mutex.  */
     QLIST_ENTRY(ThreadPoolElement) all;
 };
 
+/* Each worker owns one request queue, up to THREAD_POOL_MAX_QUEUES workers;
+ * beyond that, workers share queues.  Requests are spread round-robin over
+ * the queues that have workers.  A worker takes requests from the head of
+ * its own queue and, when that is empty, steals from the tail of the others,
+ * so that the workers only contend with each other when they run out of
+ * work.
+ */
+#define THREAD_POOL_MAX_QUEUES 16
+
+struct ThreadPoolQueue {
+    QemuMutex lock;
+    QemuSemaphore sem;
+
+    /* Workers of this queue waiting on sem and not yet claimed by
+     * thread_pool_kick_idle().  Accessed with atomics.
+     */
+    int idle_threads;
+
+    /* Written with pool->lock taken, read with atomics.  */
+    int nr_workers;
+
+    /* The following variables are protected by lock.  */
+    QTAILQ_HEAD(ThreadPoolRequestList, ThreadPoolElement) request_list;
+    uint64_t requests;
+    uint64_t steals;
+};
+
 struct ThreadPool {
     AioContext *ctx;
     QEMUBH *completion_bh;
     QemuMutex lock;
     QemuCond worker_stopped;
-    QemuSemaphore sem;
-    int max_threads;
     QEMUBH *new_thread_bh;
 
+    ThreadPoolQueue queues[THREAD_POOL_MAX_QUEUES];
+
     /* The following variables are only accessed from one AioContext. */
     QLIST_HEAD(, ThreadPoolElement) head;
+    unsigned next_queue;
 
     /* The following variables are protected by lock.  */
-    QTAILQ_HEAD(, ThreadPoolElement) request_list;
     int cur_threads;
-    int idle_threads;
     int new_threads;     /* backlog of threads we need to create */
     int pending_threads; /* threads created but not running yet */
-    bool stopping;
+    int min_threads;
+    int max_threads;
+    bool stopping;       /* also read with atomics by the workers */
 };
 
+static ThreadPoolElement *thread_pool_queue_pop(ThreadPoolQueue *queue,
+                                                bool steal)
+{
+    ThreadPoolElement *req;
+
+    if (!atomic_read(&QTAILQ_FIRST(&queue->request_list))) {
+        return NULL;
+    }
+
+    qemu_mutex_lock(&queue->lock);
+    if (steal) {
+        req = QTAILQ_LAST(&queue->request_list, ThreadPoolRequestList);
+    } else {
+        req = QTAILQ_FIRST(&queue->request_list);
+    }
+    if (req) {
+        QTAILQ_REMOVE(&queue->request_list, req, reqs);
+        req->state = THREAD_ACTIVE;
+        if (steal) {
+            queue->steals++;
+        }
+    }
+    qemu_mutex_unlock(&queue->lock);
+    return req;
+}
+
+static ThreadPoolElement *thread_pool_get_request(ThreadPool *pool,
+                                                  ThreadPoolQueue *queue)
+{
+    ThreadPoolElement *req;
+    int n = queue - pool->queues;
+    int i;
+
+    req = thread_pool_queue_pop(queue, false);
+    for (i = 1; !req && i < THREAD_POOL_MAX_QUEUES; i++) {
+        req = thread_pool_queue_pop(
+            &pool->queues[(n + i) % THREAD_POOL_MAX_QUEUES], true);
+    }
+    return req;
+}
+
+static bool thread_pool_has_requests(ThreadPool *pool)
+{
+    int i;
+
+    for (i = 0; i < THREAD_POOL_MAX_QUEUES; i++) {
+        if (atomic_read(&QTAILQ_FIRST(&pool->queues[i].request_list))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Wake up an idle worker, starting the search from queue n.  Returns false
+ * if all workers are busy; they look for more requests before going to sleep.
+ */
+static bool thread_pool_kick_idle(ThreadPool *pool, int n)
+{
+    int i;
+
+    for (i = 0; i < THREAD_POOL_MAX_QUEUES; i++) {
+        ThreadPoolQueue *queue = &pool->queues[(n + i) %
+                                               THREAD_POOL_MAX_QUEUES];
+        int idle = atomic_read(&queue->idle_threads);
+
+        while (idle > 0) {
+            int old = atomic_cmpxchg(&queue->idle_threads, idle, idle - 1);
+            if (old == idle) {
+                qemu_sem_post(&queue->sem);
+                return true;
+            }
+            idle = old;
+        }
+    }
+    return false;
+}
+
+/* Stop counting the worker as idle.  Returns true if thread_pool_kick_idle()
+ * claimed it in the meanwhile, in which case its wakeup is consumed here.
+ */
+static bool worker_leave_idle(ThreadPoolQueue *queue)
+{
+    int idle = atomic_read(&queue->idle_threads);
+
+    while (idle > 0) {
+        int old = atomic_cmpxchg(&queue->idle_threads, idle, idle - 1);
+        if (old == idle) {
+            return false;
+        }
+        idle = old;
+    }
+    qemu_sem_wait(&queue->sem);
+    return true;
+}
+
+static ThreadPoolQueue *thread_pool_least_loaded(ThreadPool *pool)
+{
+    ThreadPoolQueue *queue = &pool->queues[0];
+    int i;
+
+    for (i = 1; i < THREAD_POOL_MAX_QUEUES; i++) {
+        if (atomic_read(&pool->queues[i].nr_workers) <
+            atomic_read(&queue->nr_workers)) {
+            queue = &pool->queues[i];
+        }
+    }
+    return queue;
+}
+
+static ThreadPoolQueue *worker_assign_queue(ThreadPool *pool)
+{
+    ThreadPoolQueue *queue = thread_pool_least_loaded(pool);
+
+    /* Runs with lock taken.  */
+    atomic_set(&queue->nr_workers, queue->nr_workers + 1);
+    return queue;
+}
+
+/*
+ * Workers that exit can leave some queues without an owner while others are
+ * shared.  Move to the least loaded queue if that is better balanced.
+ */
+static ThreadPoolQueue *worker_rebalance(ThreadPool *pool,
+                                         ThreadPoolQueue *queue)
+{
+    ThreadPoolQueue *best;
+
+    if (atomic_read(&queue->nr_workers) <= 1 ||
+        atomic_read(&thread_pool_least_loaded(pool)->nr_workers) >=
+        atomic_read(&queue->nr_workers) - 1) {
+        return queue;
+    }
+
+    qemu_mutex_lock(&pool->lock);
+    best = thread_pool_least_loaded(pool);
+    if (best->nr_workers < queue->nr_workers - 1) {
+        atomic_set(&queue->nr_workers, queue->nr_workers - 1);
+        atomic_set(&best->nr_workers, best->nr_workers + 1);
+        queue = best;
+    }
+    qemu_mutex_unlock(&pool->lock);
+    return queue;
+}
+
+/*
+ * Called when the worker found no request to run.  The worker exits when
+ * the pool is stopping or has to shrink to max_threads, or when it timed out
+ * and is not one of the min_threads that are kept around.  Returns true if
+ * the worker has to exit.
+ */
+static bool worker_retire(ThreadPool *pool, ThreadPoolQueue *queue,
+                          bool timed_out)
+{
+    bool retire;
+
+    qemu_mutex_lock(&pool->lock);
+    retire = pool->stopping || pool->cur_threads > pool->max_threads ||
+             (timed_out && pool->cur_threads > pool->min_threads);
+
+    /*
+     * Keep waiting if we raced with a new request, unless the pool is
+     * shrinking.  thread_pool_submit_aio() looks at cur_threads with the
+     * lock taken after queuing the request, so either it sees this worker
+     * gone and spawns a new one, or we see the request here.
+     */
+    if (retire && !pool->stopping && thread_pool_has_requests(pool)) {
+        if (pool->cur_threads <= pool->max_threads) {
+            retire = false;
+        } else {
+            /* Pass the wakeup on, it may have been meant for a request */
+            thread_pool_kick_idle(pool, queue - pool->queues);
+        }
+    }
+
+    if (retire) {
+        atomic_set(&queue->nr_workers, queue->nr_workers - 1);
+        pool->cur_threads--;
+        qemu_cond_signal(&pool->worker_stopped);
+    }
+    qemu_mutex_unlock(&pool->lock);
+    return retire;
+}
+
 static void *worker_thread(void *opaque)
 {
     ThreadPool *pool = opaque;
+    ThreadPoolQueue *queue;
 
     qemu_mutex_lock(&pool->lock);
     pool->pending_threads--;
+    queue = worker_assign_queue(pool);
     do_spawn_thread(pool);
+    qemu_mutex_unlock(&pool->lock);
 
-    while (!pool->stopping) {
+    for (;;) {
         ThreadPoolElement *req;
+        bool timed_out = false;
         int ret;
 
-        do {
-            pool->idle_threads++;
-            qemu_mutex_unlock(&pool->lock);
-            ret = qemu_sem_timedwait(&pool->sem, 10000);
-            qemu_mutex_lock(&pool->lock);
-            pool->idle_threads--;
-        } while (ret == -1 && !QTAILQ_EMPTY(&pool->request_list));
-        if (ret == -1 || pool->stopping) {
-            break;
+        queue = worker_rebalance(pool, queue);
+        req = thread_pool_get_request(pool, queue);
+        if (!req) {
+            atomic_inc(&queue->idle_threads);
+
+            /* Pairs with smp_mb() in thread_pool_submit_aio() and
+             * thread_pool_free(): either they see this worker idle and
+             * kick it, or we see the new request or the stopping flag.
+             */
+            smp_mb();
+            req = thread_pool_get_request(pool, queue);
+            if (req || atomic_read(&pool->stopping)) {
+                worker_leave_idle(queue);
+            } else if (qemu_sem_timedwait(&queue->sem, 10000) == -1) {
+                timed_out = !worker_leave_idle(queue);
+            }
         }
 
-        req = QTAILQ_FIRST(&pool->request_list);
-        QTAILQ_REMOVE(&pool->request_list, req, reqs);
-        req->state = THREAD_ACTIVE;
-        qemu_mutex_unlock(&pool->lock);
+        if (!req) {
+            if (worker_retire(pool, queue, timed_out)) {
+                break;
+            }
+            continue;
+        }
 
         ret = req->func(req->arg);
 
@@ -109,14 +335,9 @@ static void *worker_thread(void *opaque)
         smp_wmb();
         req->state = THREAD_DONE;
 
-        qemu_mutex_lock(&pool->lock);
-
         qemu_bh_schedule(pool->completion_bh);
     }
 
-    pool->cur_threads--;
-    qemu_cond_signal(&pool->worker_stopped);
-    qemu_mutex_unlock(&pool->lock);
     return NULL;
 }
 
@@ -153,7 +374,9 @@ static void spawn_thread(ThreadPool *pool)
      * starving the current vcpu.
      *
      * If there are no idle threads, ask the main thread to create one, so we
-     * inherit the correct affinity instead of the vcpu affinity.
+     * inherit the correct affinity instead of the vcpu affinity.  For the
+     * pool of an IOThread this is the IOThread's affinity, so pinning the
+     * IOThread to the CPUs of a host NUMA node also keeps its workers there.
      */
     if (!pool->pending_threads) {
         qemu_bh_schedule(pool->new_thread_bh);
@@ -208,25 +431,24 @@ static void thread_pool_cancel(BlockAIOCB *acb)
 {
     ThreadPoolElement *elem = (ThreadPoolElement *)acb;
     ThreadPool *pool = elem->pool;
+    ThreadPoolQueue *queue = elem->queue;
 
     trace_thread_pool_cancel(elem, elem->common.opaque);
 
-    qemu_mutex_lock(&pool->lock);
-    if (elem->state == THREAD_QUEUED &&
-        /* No thread has yet started working on elem. we can try to "steal"
-         * the item from the worker if we can get a signal from the
-         * semaphore.  Because this is non-blocking, we can do it with
-         * the lock taken and ensure that elem will remain THREAD_QUEUED.
+    qemu_mutex_lock(&queue->lock);
+    if (elem->state == THREAD_QUEUED) {
+        /* No thread has yet started working on elem, and none can while
+         * we hold the lock.  A worker that was woken up for it will just
+         * find one request less in the queues.
          */
-        qemu_sem_timedwait(&pool->sem, 0) == 0) {
-        QTAILQ_REMOVE(&pool->request_list, elem, reqs);
+        QTAILQ_REMOVE(&queue->request_list, elem, reqs);
         qemu_bh_schedule(pool->completion_bh);
 
         elem->state = THREAD_DONE;
         elem->ret = -ECANCELED;
     }
 
-    qemu_mutex_unlock(&pool->lock);
+    qemu_mutex_unlock(&queue->lock);
 }
 
 static AioContext *thread_pool_get_aio_context(BlockAIOCB *acb)
@@ -242,29 +464,54 @@ static const AIOCBInfo thread_pool_aiocb_info = {
     .get_aio_context    = thread_pool_get_aio_context,
 };
 
+static ThreadPoolQueue *thread_pool_pick_queue(ThreadPool *pool)
+{
+    int i;
+
+    for (i = 0; i < THREAD_POOL_MAX_QUEUES; i++) {
+        ThreadPoolQueue *queue = &pool->queues[pool->next_queue++ %
+                                               THREAD_POOL_MAX_QUEUES];
+        if (atomic_read(&queue->nr_workers)) {
+            return queue;
+        }
+    }
+
+    /* No workers yet, the first one will be assigned the first queue */
+    return &pool->queues[0];
+}
+
 BlockAIOCB *thread_pool_submit_aio(ThreadPool *pool,
         ThreadPoolFunc *func, void *arg,
         BlockCompletionFunc *cb, void *opaque)
 {
     ThreadPoolElement *req;
+    ThreadPoolQueue *queue = thread_pool_pick_queue(pool);
 
     req = qemu_aio_get(&thread_pool_aiocb_info, NULL, cb, opaque);
     req->func = func;
     req->arg = arg;
     req->state = THREAD_QUEUED;
     req->pool = pool;
+    req->queue = queue;
 
     QLIST_INSERT_HEAD(&pool->head, req, all);
 
     trace_thread_pool_submit(pool, req, arg);
 
-    qemu_mutex_lock(&pool->lock);
-    if (pool->idle_threads == 0 && pool->cur_threads < pool->max_threads) {
-        spawn_thread(pool);
+    qemu_mutex_lock(&queue->lock);
+    queue->requests++;
+    QTAILQ_INSERT_TAIL(&queue->request_list, req, reqs);
+    qemu_mutex_unlock(&queue->lock);
+
+    /* Pairs with smp_mb() in worker_thread().  */
+    smp_mb();
+    if (!thread_pool_kick_idle(pool, queue - pool->queues)) {
+        qemu_mutex_lock(&pool->lock);
+        if (pool->cur_threads < pool->max_threads) {
+            spawn_thread(pool);
+        }
+        qemu_mutex_unlock(&pool->lock);
     }
-    QTAILQ_INSERT_TAIL(&pool->request_list, req, reqs);
-    qemu_mutex_unlock(&pool->lock);
-    qemu_sem_post(&pool->sem);
     return &req->common;
 }
 
@@ -296,8 +543,55 @@ void thread_pool_submit(ThreadPool *pool, ThreadPoolFunc *func, void *arg)
     thread_pool_submit_aio(pool, func, arg, NULL, NULL);
 }
 
+void thread_pool_update_params(ThreadPool *pool, AioContext *ctx)
+{
+    int i;
+
+    qemu_mutex_lock(&pool->lock);
+
+    pool->min_threads = ctx->thread_pool_min;
+    pool->max_threads = ctx->thread_pool_max;
+
+    /*
+     * Threads above max_threads exit as soon as they wake up, threads
+     * below min_threads are spawned right away instead of on demand.
+     */
+    for (i = pool->cur_threads; i < pool->min_threads; i++) {
+        spawn_thread(pool);
+    }
+    for (i = pool->cur_threads; i > pool->max_threads; i--) {
+        thread_pool_kick_idle(pool, 0);
+    }
+
+    qemu_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_get_stats(ThreadPool *pool, ThreadPoolStats *stats)
+{
+    int i;
+
+    qemu_mutex_lock(&pool->lock);
+    stats->threads = pool->cur_threads;
+    qemu_mutex_unlock(&pool->lock);
+
+    stats->idle_threads = 0;
+    stats->requests = 0;
+    stats->steals = 0;
+    for (i = 0; i < THREAD_POOL_MAX_QUEUES; i++) {
+        ThreadPoolQueue *queue = &pool->queues[i];
+
+        stats->idle_threads += atomic_read(&queue->idle_threads);
+        qemu_mutex_lock(&queue->lock);
+        stats->requests += queue->requests;
+        stats->steals += queue->steals;
+        qemu_mutex_unlock(&queue->lock);
+    }
+}
+
 static void thread_pool_init_one(ThreadPool *pool, AioContext *ctx)
 {
+    int i;
+
     if (!ctx) {
         ctx = qemu_get_aio_context();
     }
@@ -307,12 +601,16 @@ static void thread_pool_init_one(ThreadPool *pool, AioContext *ctx)
     pool->completion_bh = aio_bh_new(ctx, thread_pool_completion_bh, pool);
     qemu_mutex_init(&pool->lock);
     qemu_cond_init(&pool->worker_stopped);
-    qemu_sem_init(&pool->sem, 0);
-    pool->max_threads = 64;
     pool->new_thread_bh = aio_bh_new(ctx, spawn_thread_bh_fn, pool);
 
     QLIST_INIT(&pool->head);
-    QTAILQ_INIT(&pool->request_list);
+    for (i = 0; i < THREAD_POOL_MAX_QUEUES; i++) {
+        qemu_mutex_init(&pool->queues[i].lock);
+        qemu_sem_init(&pool->queues[i].sem, 0);
+        QTAILQ_INIT(&pool->queues[i].request_list);
+    }
+
+    thread_pool_update_params(pool, ctx);
 }
 
 ThreadPool *thread_pool_new(AioContext *ctx)
@@ -324,6 +622,8 @@ ThreadPool *thread_pool_new(AioContext *ctx)
 
 void thread_pool_free(ThreadPool *pool)
 {
+    int i;
+
     if (!pool) {
         return;
     }
@@ -338,16 +638,23 @@ void thread_pool_free(ThreadPool *pool)
     pool->new_threads = 0;
 
     /* Wait for worker threads to terminate */
-    pool->stopping = true;
+    atomic_set(&pool->stopping, true);
+    /* Pairs with smp_mb() in worker_thread().  */
+    smp_mb();
     while (pool->cur_threads > 0) {
-        qemu_sem_post(&pool->sem);
+        while (thread_pool_kick_idle(pool, 0)) {
+            /* nothing */
+        }
         qemu_cond_wait(&pool->worker_stopped, &pool->lock);
     }
 
     qemu_mutex_unlock(&pool->lock);
 
     qemu_bh_delete(pool->completion_bh);
-    qemu_sem_destroy(&pool->sem);
+    for (i = 0; i < THREAD_POOL_MAX_QUEUES; i++) {
+        qemu_sem_destroy(&pool->queues[i].sem);
+        qemu_mutex_destroy(&pool->queues[i].lock);
+    }
     qemu_cond_destroy(&pool->worker_stopped);
     qemu_mutex_destroy(&pool->lock);
     g_free(pool);